@@ -0,0 +1,148 @@
+#ifndef Arena_h
+#define Arena_h
+
+// A monotonic arena for short-lived scratch memory, such as the state of a
+// single routing query. Allocation bumps a pointer through large blocks and
+// deallocation does nothing; release() drops everything at once but keeps the
+// memory as a single block, so a reused arena stops calling operator new once
+// it has grown to fit its largest query. ArenaAllocator lets standard containers
+// and ExpandableHashMap draw from an arena.
+
+#include <cstddef>
+#include <new>
+#include "Instrumentation.h"
+
+class MonotonicArena
+{
+public:
+    MonotonicArena(std::size_t firstBlockSize = 64 * 1024)
+     : m_blocks(nullptr), m_curr(nullptr), m_end(nullptr), m_nextBlockSize(firstBlockSize)
+    {}
+    ~MonotonicArena()
+    {
+        freeBlocks(m_blocks);
+    }
+
+    void* allocate(std::size_t bytes, std::size_t alignment)
+    {
+        char* p = alignUp(m_curr, alignment);
+        if (p == nullptr || p + bytes > m_end)                  //current block is used up (or there is none yet)
+        {
+            addBlock(bytes + alignment);
+            p = alignUp(m_curr, alignment);
+        }
+        m_curr = p + bytes;
+        return p;
+    }
+
+    void release()                                              //everything handed out so far becomes invalid
+    {
+        if (m_blocks == nullptr)
+            return;
+        if (m_blocks->next != nullptr)                          //the last use needed several blocks, so swap them for
+        {                                                       //a single one that would have held all of it
+            std::size_t total = 0;
+            for (Block* b = m_blocks; b != nullptr; b = b->next)
+                total += b->size;
+            freeBlocks(m_blocks);
+            m_blocks = nullptr;
+            m_nextBlockSize = total;
+            addBlock(total);
+        }
+        m_curr = reinterpret_cast<char*>(m_blocks + 1);
+        m_end = m_curr + m_blocks->size;
+    }
+
+    MonotonicArena(const MonotonicArena&) = delete;
+    MonotonicArena& operator=(const MonotonicArena&) = delete;
+
+private:
+    struct Block
+    {
+        Block* next;
+        std::size_t size;
+        std::max_align_t align;                                 //keeps the usable space after the header aligned
+    };
+
+    Block* m_blocks;                                            //newest first
+    char* m_curr;
+    char* m_end;
+    std::size_t m_nextBlockSize;
+
+    static char* alignUp(char* p, std::size_t alignment)
+    {
+        if (p == nullptr)
+            return nullptr;
+        std::size_t addr = reinterpret_cast<std::size_t>(p);
+        return p + ((alignment - addr % alignment) % alignment);
+    }
+
+    void addBlock(std::size_t minimumSize)
+    {
+        std::size_t size = m_nextBlockSize;
+        while (size < minimumSize)
+            size *= 2;
+        m_nextBlockSize = size * 2;                             //grow geometrically so large queries need few blocks
+        Block* block = static_cast<Block*>(::operator new(sizeof(Block) + size));
+        block->next = m_blocks;
+        block->size = size;
+        m_blocks = block;
+        m_curr = reinterpret_cast<char*>(block + 1);
+        m_end = m_curr + size;
+        STATS_COUNT(arenaBlocks, 1);
+    }
+
+    static void freeBlocks(Block* block)
+    {
+        while (block != nullptr)
+        {
+            Block* next = block->next;
+            ::operator delete(block);
+            block = next;
+        }
+    }
+};
+
+template<typename T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+
+    ArenaAllocator(MonotonicArena* arena) noexcept
+     : m_arena(arena)
+    {}
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept
+     : m_arena(other.arena())
+    {}
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(m_arena->allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T*, std::size_t) noexcept                   //memory goes back when the arena is released
+    {}
+
+    MonotonicArena* arena() const noexcept
+    {
+        return m_arena;
+    }
+
+private:
+    MonotonicArena* m_arena;
+};
+
+template<typename T, typename U>
+inline bool operator==(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs) noexcept
+{
+    return lhs.arena() == rhs.arena();
+}
+
+template<typename T, typename U>
+inline bool operator!=(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs) noexcept
+{
+    return !(lhs == rhs);
+}
+
+#endif /* Arena_h */
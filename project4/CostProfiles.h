@@ -0,0 +1,317 @@
+#ifndef CostProfiles_h
+#define CostProfiles_h
+
+// Edge cost profiles for routing, and the cheapest-route search they plug
+// into. A profile is a policy class with
+//
+//     static const bool TURN_AWARE;
+//     double edgeCost(const StreetGraph& graph, int edge) const;
+//     double turnCost(const StreetGraph& graph, int fromEdge, int toEdge) const;
+//
+// and CheapestRouteSearch is instantiated for each profile, so its inner loop
+// calls the profile's functions directly and they can be inlined. Costs must
+// not be negative. turnCost is only called when TURN_AWARE is true, in which
+// case the search keeps a label per edge (the way a node was reached) instead
+// of per node, so that the cost of a turn can depend on it.
+
+#include "StreetGraph.h"
+#include "ExpandableHashMap.h"
+#include "Arena.h"
+#include "Instrumentation.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+  // Every segment costs the same, so the cheapest route is the one through
+  // the fewest segments
+class HopProfile
+{
+public:
+    static const bool TURN_AWARE = false;
+    double edgeCost(const StreetGraph&, int) const { return 1; }
+    double turnCost(const StreetGraph&, int, int) const { return 0; }
+};
+
+  // Cost is the length of the segment in miles
+class DistanceProfile
+{
+public:
+    static const bool TURN_AWARE = false;
+    double edgeCost(const StreetGraph& graph, int edge) const { return graph.edgeLength(edge); }
+    double turnCost(const StreetGraph&, int, int) const { return 0; }
+};
+
+  // Whether the length characters at word spell lower, ignoring case
+inline bool sameWord(const char* word, std::size_t length, const char* lower)
+{
+    for (std::size_t i=0; i<length; i++)
+        if (lower[i] == '\0' || std::tolower((unsigned char)word[i]) != lower[i])
+            return false;
+    return lower[length] == '\0';
+}
+
+  // A guess at the speed limit in miles per hour, from the kind of street the
+  // name ends with (ignoring a trailing direction, as in "Charles E Young
+  // Drive West"). Reads the name in place, without allocating.
+inline double streetSpeed(const char* name)
+{
+    static const struct { const char* kind; double speed; } SPEEDS[] = {
+        { "freeway", 55 }, { "fwy", 55 }, { "highway", 55 }, { "hwy", 55 },
+        { "boulevard", 35 }, { "blvd", 35 }, { "parkway", 35 }, { "pkwy", 35 },
+        { "avenue", 30 }, { "ave", 30 },
+        { "walk", 10 }, { "path", 10 }, { "trail", 10 }, { "alley", 10 }, { "plaza", 10 },
+        { "court", 15 }, { "ct", 15 }, { "place", 15 }, { "pl", 15 }, { "lane", 15 }, { "ln", 15 },
+        { "terrace", 15 }, { "circle", 15 }
+    };
+    static const char* const DIRECTIONS[] = { "north", "south", "east", "west" };
+    
+    //step back a word at a time from the end, past directions as long as some other word comes before them
+    const char* end = name + std::strlen(name);
+    const char* word;
+    for (;;)
+    {
+        while (end > name && end[-1] == ' ')
+            end--;
+        word = end;
+        while (word > name && word[-1] != ' ')
+            word--;
+        const char* before = word;
+        while (before > name && before[-1] == ' ')
+            before--;
+        bool direction = false;
+        for (const char* d : DIRECTIONS)
+            direction |= sameWord(word, end - word, d);
+        if (!direction || before == name)
+            break;
+        end = before;
+    }
+    if (word < end)
+        for (const auto& s : SPEEDS)
+            if (sameWord(word, end - word, s.kind))
+                return s.speed;
+    return 25;                                                  //streets, drives, roads and anything unrecognised
+}
+
+  // Cost is the time to drive the segment in hours, at the speed streetSpeed
+  // gives for its street. The table of speeds is built for each query, in
+  // that query's arena.
+class TravelTimeProfile
+{
+public:
+    static const bool TURN_AWARE = false;
+    TravelTimeProfile(const StreetGraph& graph, MonotonicArena& arena)
+     : m_hoursPerMile(ArenaAllocator<double>(&arena))
+    {
+        m_hoursPerMile.reserve(graph.streetCount());            //worked out once per street, not once per edge
+        for (int s=0; s<graph.streetCount(); s++)
+            m_hoursPerMile.push_back(1 / streetSpeed(graph.streetName(s)));
+    }
+    double edgeCost(const StreetGraph& graph, int edge) const
+    {
+        return graph.edgeLength(edge) * m_hoursPerMile[graph.edgeStreet(edge)];
+    }
+    double turnCost(const StreetGraph&, int, int) const { return 0; }
+private:
+    std::vector<double, ArenaAllocator<double> > m_hoursPerMile;
+};
+
+  // Another profile's costs, plus a penalty for every left turn and U-turn
+  // (in the other profile's units)
+template<typename Base>
+class TurnPenaltyProfile : public Base
+{
+public:
+    static const bool TURN_AWARE = true;
+    TurnPenaltyProfile(const Base& base, double leftTurnCost, double uTurnCost)
+     : Base(base), m_leftTurnCost(leftTurnCost), m_uTurnCost(uTurnCost)
+    {}
+    double turnCost(const StreetGraph& graph, int fromEdge, int toEdge) const
+    {
+        //the angle angleBetween2Lines gives for the two segments, from the angles worked out when the map was
+        //loaded; a turn of 30 degrees or more to the left counts, and heading straight back where we came from
+        //is a U-turn; worked out without branches, since this runs for every edge relaxed
+        double angle = graph.edgeAngle(toEdge) - graph.edgeAngle(fromEdge);
+        angle += 360 * (angle < 0);
+        bool uTurn = graph.edgeTo(toEdge) == graph.edgeFrom(fromEdge);
+        bool left = !uTurn & (angle >= 30) & (angle < 180);
+        return m_leftTurnCost * left + m_uTurnCost * uTurn;
+    }
+private:
+    double m_leftTurnCost;
+    double m_uTurnCost;
+};
+
+  // Dijkstra's algorithm over a StreetGraph, skipping closed edges. All of the
+  // search state comes from the arena it is given.
+template<typename Profile>
+class CheapestRouteSearch
+{
+public:
+    CheapestRouteSearch(const StreetGraph& graph, const Profile& profile, MonotonicArena& arena)
+     : m_graph(graph), m_profile(profile),
+       m_labels(0.5, LabelAllocator(&arena)), m_queue(std::greater<Entry>(), EntryVector(EntryAllocator(&arena))),
+       m_end(-1)
+    {}
+
+    //settles nodes in order of cost from startNode, calling onSettle(node, cost) for each, until endNode is
+    //settled (which makes it return true), costs go over maxCost or there is nowhere left to go; for turn
+    //aware profiles a node is settled once for every edge it is reached by. Every settled node's edges are
+    //followed, endNode's included, so running again from the same start carries on from where the last run
+    //stopped. A state only reachable at infinite cost is never reached
+    template<typename OnSettle>
+    bool run(int startNode, int endNode, double maxCost, OnSettle onSettle)
+    {
+        return run(startNode, endNode, maxCost, onSettle, std::integral_constant<bool, Profile::TURN_AWARE>());
+    }
+    bool run(int startNode, int endNode)
+    {
+        return run(startNode, endNode, std::numeric_limits<double>::infinity(), [](int, double) {});
+    }
+
+    //the edges from the start to the end that the last run reached, in order
+    void route(std::vector<int>& edges) const
+    {
+        edges.clear();
+        if (Profile::TURN_AWARE)                                //every state is itself the last edge taken
+            for (int e = m_end; e != -1; e = m_labels.find(e)->via)
+                edges.push_back(e);
+        else if (m_end != -1)
+            for (int e = m_labels.find(m_end)->via; e != -1; e = m_labels.find(m_graph.edgeFrom(e))->via)
+                edges.push_back(e);
+        std::reverse(edges.begin(), edges.end());
+    }
+
+    //whether the runs so far have settled a state, and then the cost of the cheapest way to it and the edge it
+    //was reached by (-1 for the start)
+    bool settled(int state) const
+    {
+        const Label* label = m_labels.find(state);
+        return label != nullptr && label->settled;
+    }
+    double cost(int state) const { return m_labels.find(state)->cost; }
+    double settledCost(int state) const                         //infinity if state hasn't been settled
+    {
+        const Label* label = m_labels.find(state);
+        return label != nullptr && label->settled ? label->cost : std::numeric_limits<double>::infinity();
+    }
+    int via(int state) const { return m_labels.find(state)->via; }
+
+private:
+    struct Label
+    {
+        double cost;
+        int via;                                                //the edge before this state on the cheapest way to it
+        bool settled;
+    };
+    typedef std::pair<double, int> Entry;                       //cost and state
+    typedef ArenaAllocator<std::pair<const int, Label> > LabelAllocator;
+    typedef ArenaAllocator<Entry> EntryAllocator;
+    typedef std::vector<Entry, EntryAllocator> EntryVector;
+
+    const StreetGraph& m_graph;
+    const Profile& m_profile;
+    ExpandableHashMap<int, Label, IdHasher, LabelAllocator> m_labels;   //by node, or by the edge just taken for turn aware profiles
+    std::priority_queue<Entry, EntryVector, std::greater<Entry> > m_queue;
+    int m_end;                                                  //the state that reached the end
+
+    void reach(int state, double cost, int via)
+    {
+        if (!(cost < std::numeric_limits<double>::infinity()))
+            return;
+        Label* label = m_labels.find(state);
+        if (label == nullptr)
+        {
+            Label fresh = { cost, via, false };
+            m_labels.associate(state, fresh);
+        }
+        else if (label->settled || cost >= label->cost)
+            return;
+        else
+        {
+            label->cost = cost;
+            label->via = via;
+        }
+        m_queue.push(Entry(cost, state));                       //an older, costlier entry may stay behind; it is skipped
+    }
+
+    //true once state has been taken off the queue for good, false if this entry is out of date
+    bool settle(int state)
+    {
+        Label* label = m_labels.find(state);
+        if (label->settled)
+            return false;
+        label->settled = true;
+        return true;
+    }
+
+    template<typename OnSettle>
+    bool run(int startNode, int endNode, double maxCost, OnSettle onSettle, std::false_type)
+    {
+        reach(startNode, 0, -1);
+        while (!m_queue.empty())
+        {
+            Entry top = m_queue.top();
+            if (top.first > maxCost)                            //left queued for a later run with a higher limit
+                break;
+            m_queue.pop();
+            int node = top.second;
+            if (!settle(node))
+                continue;
+            STATS_COUNT(nodesExpanded, 1);
+            onSettle(node, top.first);
+            for (int e=m_graph.firstEdge(node); e<m_graph.endEdge(node); e++)
+                if (!m_graph.edgeClosed(e))
+                    reach(m_graph.edgeTo(e), top.first + m_profile.edgeCost(m_graph, e), e);
+            if (node == endNode)
+            {
+                m_end = node;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template<typename OnSettle>
+    bool run(int startNode, int endNode, double maxCost, OnSettle onSettle, std::true_type)
+    {
+        if (startNode == endNode)
+        {
+            onSettle(startNode, 0);
+            return true;                                        //m_end stays -1, which is the empty route
+        }
+        for (int e=m_graph.firstEdge(startNode); e<m_graph.endEdge(startNode); e++)
+            if (!m_graph.edgeClosed(e))                         //no turn to pay for on the way out of the start
+                reach(e, m_profile.edgeCost(m_graph, e), -1);
+        while (!m_queue.empty())
+        {
+            Entry top = m_queue.top();
+            if (top.first > maxCost)                            //left queued for a later run with a higher limit
+                break;
+            m_queue.pop();
+            int edge = top.second;
+            if (!settle(edge))
+                continue;
+            STATS_COUNT(nodesExpanded, 1);
+            int node = m_graph.edgeTo(edge);
+            onSettle(node, top.first);
+            for (int e=m_graph.firstEdge(node); e<m_graph.endEdge(node); e++)
+                if (!m_graph.edgeClosed(e))
+                    reach(e, top.first + m_profile.turnCost(m_graph, edge, e) + m_profile.edgeCost(m_graph, e), edge);
+            if (node == endNode)
+            {
+                m_end = edge;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+#endif /* CostProfiles_h */
@@ -1,23 +1,563 @@
 #include "provided.h"
+#include "Instrumentation.h"
+#include "StreetGraph.h"
+#include <algorithm>
 #include <cmath>
 #include <vector>
 #include <random>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <limits>
 
 using namespace std;
 
+  // The deliveries by their position along a Hilbert curve through their
+  // bounding box, ties in the order they were given
+static void hilbertOrder(const vector<DeliveryRequest>& deliveries, vector<int>& order)
+{
+    double minLat = 90, maxLat = -90, minLon = 180, maxLon = -180;
+    for (int i=0; i<(int)deliveries.size(); i++)
+    {
+        minLat = min(minLat, deliveries[i].location.latitude);
+        maxLat = max(maxLat, deliveries[i].location.latitude);
+        minLon = min(minLon, deliveries[i].location.longitude);
+        maxLon = max(maxLon, deliveries[i].location.longitude);
+    }
+    double latScale = maxLat > minLat ? 65535 / (maxLat - minLat) : 0;
+    double lonScale = maxLon > minLon ? 65535 / (maxLon - minLon) : 0;
+    vector<pair<unsigned long long, int> > keys(deliveries.size());
+    for (int i=0; i<(int)deliveries.size(); i++)
+        keys[i] = make_pair(hilbertIndex((unsigned int)((deliveries[i].location.longitude - minLon) * lonScale),
+                                         (unsigned int)((deliveries[i].location.latitude - minLat) * latScale)), i);
+    sort(keys.begin(), keys.end());
+    order.resize(deliveries.size());
+    for (int i=0; i<(int)keys.size(); i++)
+        order[i] = keys[i].second;
+}
+
+  // Points bucketed into a grid of square cells over their bounding box,
+  // about two to a cell, for finding the nearest ones without looking at
+  // every point. Positions are in miles on a flat projection around the
+  // middle of the box, which is close enough across a city to pick the
+  // nearest stop; the tours built with it are measured by distanceEarthMiles.
+class StopGrid
+{
+public:
+    StopGrid(const vector<GeoCoord>& points);
+    int nearest(const GeoCoord& gc) const;      //the nearest point not removed, or -1 if there are none
+    void nearest(int point, int count, vector<int>& found) const;  //up to count others nearest to a point, nearest first
+    void remove(int point);
+    double distance(int a, int b) const { return hypot(m_x[a] - m_x[b], m_y[a] - m_y[b]); }
+private:
+    vector<double> m_x, m_y;
+    double m_lonMiles;                          //miles per degree of longitude at the middle of the box
+    double m_minX, m_minY, m_cellSize;
+    int m_columns, m_rows;
+    vector<vector<int> > m_cells;
+    vector<int> m_slot;                         //where each point is in its cell, -1 once removed
+    int cellOf(double x, double y, int& column, int& row) const;
+    template<typename Visit, typename Beat>
+    void search(double x, double y, Visit visit, Beat beat) const;
+};
+
+StopGrid::StopGrid(const vector<GeoCoord>& points)
+ : m_x(points.size()), m_y(points.size()), m_slot(points.size())
+{
+    double minLat = 90, maxLat = -90;
+    for (int i=0; i<(int)points.size(); i++)
+    {
+        minLat = min(minLat, points[i].latitude);
+        maxLat = max(maxLat, points[i].latitude);
+    }
+    m_lonMiles = 69.172 * cos(deg2rad(points.empty() ? 0 : (minLat + maxLat) / 2));
+    double maxX = 0, maxY = 0;
+    for (int i=0; i<(int)points.size(); i++)
+    {
+        m_x[i] = points[i].longitude * m_lonMiles;
+        m_y[i] = points[i].latitude * 69.0;
+        if (i == 0 || m_x[i] < m_minX) m_minX = m_x[i];
+        if (i == 0 || m_y[i] < m_minY) m_minY = m_y[i];
+        if (i == 0 || m_x[i] > maxX) maxX = m_x[i];
+        if (i == 0 || m_y[i] > maxY) maxY = m_y[i];
+    }
+    double area = max((maxX - m_minX) * (maxY - m_minY), 1e-12);
+    m_cellSize = max(sqrt(2 * area / max((int)points.size(), 1)), max(maxX - m_minX, maxY - m_minY) / 4096);
+    m_cellSize = max(m_cellSize, 1e-9);
+    m_columns = (int)((maxX - m_minX) / m_cellSize) + 1;
+    m_rows = (int)((maxY - m_minY) / m_cellSize) + 1;
+    m_cells.resize((size_t)m_columns * m_rows);
+    for (int i=0; i<(int)points.size(); i++)
+    {
+        int column, row;
+        vector<int>& cell = m_cells[cellOf(m_x[i], m_y[i], column, row)];
+        m_slot[i] = (int)cell.size();
+        cell.push_back(i);
+    }
+}
+
+int StopGrid::cellOf(double x, double y, int& column, int& row) const
+{
+    column = max(0, min(m_columns - 1, (int)floor((x - m_minX) / m_cellSize)));
+    row = max(0, min(m_rows - 1, (int)floor((y - m_minY) / m_cellSize)));
+    return row * m_columns + column;
+}
+
+  // Calls visit(point, distance) for points in rings of cells around (x, y),
+  // each ring one cell further out, until no point outside the rings so far
+  // can be closer than beat()
+template<typename Visit, typename Beat>
+void StopGrid::search(double x, double y, Visit visit, Beat beat) const
+{
+    int column, row;
+    cellOf(x, y, column, row);
+    for (int r=0; ; r++)
+    {
+        for (int dy=-r; dy<=r; dy++)
+        {
+            int cy = row + dy;
+            if (cy < 0 || cy >= m_rows)
+                continue;
+            int step = (dy == -r || dy == r) ? 1 : 2*r;    //whole rows at the top and bottom, the ends of the others
+            for (int dx=-r; dx<=r; dx += max(step, 1))
+            {
+                int cx = column + dx;
+                if (cx < 0 || cx >= m_columns)
+                    continue;
+                const vector<int>& cell = m_cells[cy * m_columns + cx];
+                for (int k=0; k<(int)cell.size(); k++)
+                    visit(cell[k], hypot(m_x[cell[k]] - x, m_y[cell[k]] - y));
+            }
+        }
+        //the closest any cell outside this ring can be, on a side where there are any
+        double outside = numeric_limits<double>::infinity();
+        if (column - r > 0)
+            outside = min(outside, max(0.0, x - (m_minX + (column - r) * m_cellSize)));
+        if (column + r < m_columns - 1)
+            outside = min(outside, max(0.0, m_minX + (column + r + 1) * m_cellSize - x));
+        if (row - r > 0)
+            outside = min(outside, max(0.0, y - (m_minY + (row - r) * m_cellSize)));
+        if (row + r < m_rows - 1)
+            outside = min(outside, max(0.0, m_minY + (row + r + 1) * m_cellSize - y));
+        if (outside == numeric_limits<double>::infinity() || beat() <= outside)
+            return;
+    }
+}
+
+int StopGrid::nearest(const GeoCoord& gc) const
+{
+    int best = -1;
+    double bestDistance = numeric_limits<double>::infinity();
+    search(gc.longitude * m_lonMiles, gc.latitude * 69.0, [&](int point, double distance) {
+        if (distance < bestDistance || (distance == bestDistance && point < best))
+        {
+            best = point;
+            bestDistance = distance;
+        }
+    }, [&]() { return bestDistance; });
+    return best;
+}
+
+void StopGrid::nearest(int point, int count, vector<int>& found) const
+{
+    vector<pair<double, int> > best;                //the nearest so far, in order
+    search(m_x[point], m_y[point], [&](int other, double distance) {
+        pair<double, int> candidate(distance, other);
+        if (other != point && ((int)best.size() < count || candidate < best.back()))
+        {
+            if ((int)best.size() == count)
+                best.pop_back();
+            best.insert(upper_bound(best.begin(), best.end(), candidate), candidate);
+        }
+    }, [&]() { return (int)best.size() < count ? numeric_limits<double>::infinity() : best.back().first; });
+    found.clear();
+    for (int i=0; i<(int)best.size(); i++)
+        found.push_back(best[i].second);
+}
+
+void StopGrid::remove(int point)
+{
+    int column, row;
+    vector<int>& cell = m_cells[cellOf(m_x[point], m_y[point], column, row)];
+    int slot = m_slot[point];
+    cell[slot] = cell.back();                       //the last point in the cell takes its place
+    m_slot[cell[slot]] = slot;
+    cell.pop_back();
+    m_slot[point] = -1;
+}
+
+static const int LOCAL_SEARCH_NEIGHBOURS = 8; //nearest stops LocalSearch tries linking each stop to
+
+  // 2-opt and Or-opt moves over a path through the deliveries between two
+  // fixed ends: reversing a stretch of the path, or moving up to three stops
+  // in a row (either way round) to between two others. Only links from a stop
+  // to its nearest few, as StopGrid finds them, are tried, and only around
+  // the stops whose links have changed since they were last looked at, so a
+  // path that is already good is improved in time close to the number of
+  // stops touched, and keeps its shape. Orders are indices into deliveries.
+class LocalSearch
+{
+public:
+    LocalSearch(const GeoCoord& from, const GeoCoord& to, const vector<DeliveryRequest>& deliveries);
+    void improve(vector<int>& order);                               //looking at every stop
+    void improve(vector<int>& order, const vector<int>& touched);   //looking at the stops at those positions
+    double length(const vector<int>& order) const;
+private:
+    int m_stops;
+    vector<double> m_x, m_y, m_z;               //on a unit sphere: from, then the deliveries, then to
+    vector<vector<int> > m_nearest;             //for each delivery, the nearest others, nearest first
+    vector<int> m_path;                         //from, the order, to
+    vector<int> m_pos;                          //where each point is in m_path
+    vector<int> m_queue;
+    vector<char> m_queued;
+    double distance(int a, int b) const
+    {
+        double dx = m_x[a] - m_x[b], dy = m_y[a] - m_y[b], dz = m_z[a] - m_z[b];
+        return 2 * 6371.0 / 1.609344 * asin(min(1.0, sqrt(dx*dx + dy*dy + dz*dz) / 2));
+    }
+    void touch(int point);
+    void reverse(int first, int last);          //the points at those positions
+    bool twoOpt(int a);
+    bool orOpt(int a);
+    void run(vector<int>& order);
+};
+
+LocalSearch::LocalSearch(const GeoCoord& from, const GeoCoord& to, const vector<DeliveryRequest>& deliveries)
+ : m_stops((int)deliveries.size()), m_x(m_stops+2), m_y(m_stops+2), m_z(m_stops+2), m_nearest(m_stops+2),
+   m_path(m_stops+2), m_pos(m_stops+2), m_queued(m_stops+2, false)
+{
+    vector<GeoCoord> points(m_stops);
+    for (int i=0; i<=m_stops+1; i++)
+    {
+        const GeoCoord& gc = i == 0 ? from : i == m_stops+1 ? to : deliveries[i-1].location;
+        if (i > 0 && i <= m_stops)
+            points[i-1] = gc;
+        m_x[i] = cos(deg2rad(gc.latitude)) * cos(deg2rad(gc.longitude));
+        m_y[i] = cos(deg2rad(gc.latitude)) * sin(deg2rad(gc.longitude));
+        m_z[i] = sin(deg2rad(gc.latitude));
+    }
+    StopGrid grid(points);
+    for (int i=0; i<m_stops; i++)
+    {
+        grid.nearest(i, LOCAL_SEARCH_NEIGHBOURS, m_nearest[i+1]);
+        for (int k=0; k<(int)m_nearest[i+1].size(); k++)
+            m_nearest[i+1][k]++;
+    }
+}
+
+void LocalSearch::improve(vector<int>& order)
+{
+    for (int i=1; i<=m_stops; i++)
+        touch(i);
+    run(order);
+}
+
+void LocalSearch::improve(vector<int>& order, const vector<int>& touched)
+{
+    for (int k=0; k<(int)touched.size(); k++)
+        if (touched[k] >= 0 && touched[k] < m_stops)
+            touch(order[touched[k]] + 1);
+    run(order);
+}
+
+double LocalSearch::length(const vector<int>& order) const
+{
+    double total = 0;
+    for (int i=0; i<=m_stops; i++)
+        total += distance(i == 0 ? 0 : order[i-1] + 1, i == m_stops ? m_stops + 1 : order[i] + 1);
+    return total;
+}
+
+void LocalSearch::touch(int point)
+{
+    if (point >= 1 && point <= m_stops && !m_queued[point])
+    {
+        m_queued[point] = true;
+        m_queue.push_back(point);
+    }
+}
+
+void LocalSearch::reverse(int first, int last)
+{
+    for (; first < last; first++, last--)
+    {
+        swap(m_path[first], m_path[last]);
+        m_pos[m_path[first]] = first;
+        m_pos[m_path[last]] = last;
+    }
+}
+
+bool LocalSearch::twoOpt(int a)
+{
+    //replace the link from a to its neighbour on one side, and from c to its neighbour on the same side, with a
+    //link from a to c and one between the two neighbours, reversing the stretch between
+    for (int side=1; side>=-1; side-=2)
+    {
+        int b = m_path[m_pos[a] + side];
+        double ab = distance(a, b);
+        for (int k=0; k<(int)m_nearest[a].size(); k++)
+        {
+            int c = m_nearest[a][k];
+            double ac = distance(a, c);
+            if (ac >= ab)
+                break;
+            int d = m_path[m_pos[c] + side];
+            if (c == b || d == a)
+                continue;
+            if (ab + distance(c, d) - ac - distance(b, d) > 1e-9)
+            {
+                int i = m_pos[a], j = m_pos[c];
+                if (side == 1)
+                    i < j ? reverse(i+1, j) : reverse(j+1, i);
+                else
+                    i < j ? reverse(i, j-1) : reverse(j, i-1);
+                touch(a); touch(b); touch(c); touch(d);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool LocalSearch::orOpt(int a)
+{
+    //take out the run of up to three stops starting at a, close the gap, and put the run back in between c and
+    //its neighbour on either side, whichever way round is shorter
+    for (int length=1; length<=3; length++)
+    {
+        int first = m_pos[a], last = first + length - 1;
+        if (last > m_stops)
+            break;
+        int e = m_path[last], before = m_path[first-1], after = m_path[last+1];
+        double removed = distance(before, a) + distance(e, after) - distance(before, after);
+        if (removed <= 1e-9)
+            continue;
+        for (int end=0; end<2; end++)
+        {
+            int near = end == 0 ? a : e;
+            for (int k=0; k<(int)m_nearest[near].size(); k++)
+            {
+                int c = m_nearest[near][k];
+                if (distance(near, c) >= removed)
+                    break;
+                if (m_pos[c] >= first && m_pos[c] <= last)
+                    continue;
+                for (int side=1; side>=-1; side-=2)
+                {
+                    int d = m_path[m_pos[c] + side];
+                    if (m_pos[d] >= first && m_pos[d] <= last)
+                        continue;
+                    int left = side == 1 ? c : d, right = side == 1 ? d : c;   //the run goes between these
+                    double forward = distance(left, a) + distance(e, right);
+                    double backward = distance(left, e) + distance(a, right);
+                    double added = min(forward, backward) - distance(left, right);
+                    if (removed - added > 1e-9)
+                    {
+                        vector<int> run(m_path.begin() + first, m_path.begin() + last + 1);
+                        if (backward < forward)
+                            std::reverse(run.begin(), run.end());
+                        m_path.erase(m_path.begin() + first, m_path.begin() + last + 1);
+                        int at = m_pos[right] > last ? m_pos[right] - length : m_pos[right];
+                        m_path.insert(m_path.begin() + at, run.begin(), run.end());
+                        int low = min(first, at), high = max(last, at + length - 1);
+                        for (int i=low; i<=high; i++)
+                            m_pos[m_path[i]] = i;
+                        touch(before); touch(after); touch(left); touch(right); touch(a); touch(e);
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+    return false;
+}
+
+void LocalSearch::run(vector<int>& order)
+{
+    m_path[0] = 0;
+    for (int i=0; i<m_stops; i++)
+        m_path[i+1] = order[i] + 1;
+    m_path[m_stops+1] = m_stops+1;
+    for (int i=0; i<=m_stops+1; i++)
+        m_pos[m_path[i]] = i;
+    while (!m_queue.empty())
+    {
+        int a = m_queue.back();
+        m_queue.pop_back();
+        m_queued[a] = false;
+        if (twoOpt(a) || orOpt(a))
+            touch(a);
+    }
+    for (int i=0; i<m_stops; i++)
+        order[i] = m_path[i+1] - 1;
+}
+
+static const int SMALL_BATCH = 8;               //batches up to this size are ordered by SmallBatchOrder
+
+  // The shortest round trip from the depot through exactly N deliveries,
+  // found by trying every order. Everything it needs is in fixed size arrays,
+  // so nothing is allocated. Orders are built a stop at a time, nearest first,
+  // and one is given up as soon as the stops so far plus the least the rest
+  // could add (the cheapest way into each stop left, and the cheapest way
+  // back, or the way straight back from the last stop if that is more) are no
+  // shorter than the best whole order, which never loses the shortest. A
+  // round trip and its reverse are the same length; the one starting with
+  // the earlier of its first and last deliveries (in the order given) is kept.
+template<int N>
+class SmallBatchOrder
+{
+public:
+    SmallBatchOrder(const GeoCoord& depot, const vector<DeliveryRequest>& deliveries)
+     : m_bestDistance(numeric_limits<double>::infinity()), m_evaluations(0)
+    {
+        for (int i=0; i<N; i++)
+        {
+            m_fromDepot[i] = distanceEarthMiles(depot, deliveries[i].location);
+            m_toDepot[i] = distanceEarthMiles(deliveries[i].location, depot);
+            for (int j=0; j<N; j++)
+                m_between[i][j] = distanceEarthMiles(deliveries[i].location, deliveries[j].location);
+            m_used[i] = false;
+        }
+        m_cheapestBack = numeric_limits<double>::infinity();
+        double cheapestIn = 0;
+        for (int j=0; j<N; j++)
+        {
+            m_cheapestIn[j] = m_fromDepot[j];
+            for (int i=0; i<N; i++)
+                if (i != j)
+                    m_cheapestIn[j] = min(m_cheapestIn[j], m_between[i][j]);
+            cheapestIn += m_cheapestIn[j];
+            m_cheapestBack = min(m_cheapestBack, m_toDepot[j]);
+        }
+        for (int i=0; i<=N; i++)                //the depot's list comes last
+        {
+            const double* distances = i < N ? m_between[i] : m_fromDepot;
+            for (int j=0; j<N; j++)
+                m_nearest[i][j] = j;
+            sort(m_nearest[i], m_nearest[i] + N, [&](int a, int b) { return distances[a] < distances[b]; });
+        }
+        extend(0, 0, cheapestIn);
+        if (m_best[0] > m_best[N-1])
+            reverse(m_best, m_best + N);
+    }
+    
+    //puts deliveries in the shortest order, moving them about in place
+    void apply(vector<DeliveryRequest>& deliveries) const
+    {
+        int at[N], held[N];                     //where each delivery is now, and which delivery each place holds
+        for (int i=0; i<N; i++)
+            at[i] = held[i] = i;
+        for (int i=0; i<N; i++)
+        {
+            int from = at[m_best[i]];
+            swap(deliveries[i], deliveries[from]);
+            at[held[i]] = from;
+            held[from] = held[i];
+            at[m_best[i]] = i;
+            held[i] = m_best[i];
+        }
+    }
+    double distance() const { return m_bestDistance; }
+    long long evaluations() const { return m_evaluations; }
+    
+private:
+    double m_between[N][N], m_fromDepot[N], m_toDepot[N];
+    double m_cheapestIn[N], m_cheapestBack;     //the least it can cost to get to each delivery, and back to the depot
+    int m_nearest[N+1][N];                      //the deliveries nearest first from each one and then from the depot
+    int m_order[N], m_best[N];
+    bool m_used[N];
+    double m_bestDistance;
+    long long m_evaluations;
+    
+    void extend(int depth, double length, double restIn)
+    {
+        if (depth == N)
+        {
+            length += m_toDepot[m_order[N-1]];
+            if (length < m_bestDistance)
+            {
+                m_bestDistance = length;
+                copy(m_order, m_order + N, m_best);
+            }
+            return;
+        }
+        int last = depth == 0 ? N : m_order[depth-1];
+        for (int k=0; k<N; k++)
+        {
+            int next = m_nearest[last][k];
+            if (m_used[next])
+                continue;
+            double through = length + (depth == 0 ? m_fromDepot[next] : m_between[last][next]);
+            m_evaluations++;
+            double rest = restIn - m_cheapestIn[next];
+            if (through + max(rest + m_cheapestBack, m_toDepot[next]) >= m_bestDistance)
+                continue;
+            m_used[next] = true;
+            m_order[depth] = next;
+            extend(depth + 1, through, rest);
+            m_used[next] = false;
+        }
+    }
+};
+
+template<int N>
+static double orderSmallBatch(const GeoCoord& depot, vector<DeliveryRequest>& deliveries, long long& evaluations)
+{
+    SmallBatchOrder<N> order(depot, deliveries);
+    order.apply(deliveries);
+    evaluations = order.evaluations();
+    return order.distance();
+}
+
 class DeliveryOptimizerImpl
 {
 public:
-    DeliveryOptimizerImpl(const StreetMap* sm);
+    DeliveryOptimizerImpl(const StreetMap* sm, const OptimizerOptions& options);
     ~DeliveryOptimizerImpl();
     void optimizeDeliveryOrder(
         const GeoCoord& depot,
         vector<DeliveryRequest>& deliveries,
         double& oldCrowDistance,
-        double& newCrowDistance) const;
+        double& newCrowDistance,
+        double* lowerBound) const;
 private:
     const StreetMap* m_streetmap;               //maintain a pointer to the map of all the streets
-    double calcCurrCrowDistance(const GeoCoord depot, vector<DeliveryRequest>& deliveries) const; //get the crow distance from the depot and back through the deliveries in the given vector
+    OptimizerOptions m_options;                 //seed, number of independent starts and threads to run them on
+    struct SearchResult
+    {
+        vector<DeliveryRequest> s_order;
+        double s_distance;
+        long long s_evaluations;
+    };
+    struct Cluster
+    {
+        GeoCoord s_from;                        //the depot, or the last stop of the cluster visited before
+        GeoCoord s_to;                          //the depot, or the first stop of the cluster visited after
+        vector<DeliveryRequest> s_deliveries;
+    };
+    void search(const GeoCoord& from, const GeoCoord& to, vector<DeliveryRequest> deliveries,
+                long long evaluationBudget, double timeShare, int cluster, int startIndex,
+                chrono::steady_clock::time_point started,
+                SearchResult& result) const;    //one independent start with its own random engine
+    void makeClusters(const GeoCoord& depot, const vector<DeliveryRequest>& deliveries,
+                      vector<Cluster>& clusters) const;
+    void constructOrder(const GeoCoord& from, const GeoCoord& to, vector<DeliveryRequest>& deliveries) const;
+    void tightenOrder(const GeoCoord& from, const GeoCoord& to,
+                      vector<DeliveryRequest>& deliveries) const;  //LocalSearch until no move helps
+    void nearestNeighbourOrder(const GeoCoord& from, const vector<DeliveryRequest>& deliveries, vector<int>& order) const;
+    void greedyEdgeOrder(const GeoCoord& from, const vector<DeliveryRequest>& deliveries, vector<int>& order) const;
+    void curveOrder(const GeoCoord& from, const GeoCoord& to, const vector<DeliveryRequest>& deliveries,
+                    vector<int>& order) const;
+    bool orderExactly(const GeoCoord& from, const GeoCoord& to, const vector<DeliveryRequest>& deliveries,
+                      SearchResult& result) const;  //false if the deliveries go to more than exactStops places
+    double crowDistanceBound(const GeoCoord& depot, const vector<DeliveryRequest>& deliveries,
+                             double bestDistance) const;    //no tour through the deliveries is shorter than this
+    mutable mutex m_progressMutex;              //starts on different threads take turns calling the progress callback
+    void reportProgress(int cluster, int startIndex, long long evaluations, chrono::steady_clock::time_point started,
+                        double bestDistance) const;
+    double calcCurrCrowDistance(const GeoCoord& start, vector<DeliveryRequest>& deliveries, const GeoCoord& end) const; //get the crow distance from start to end through the deliveries in the given vector
     void putSameLocDeliveriesTogether(vector<DeliveryRequest>& deliveries) const;   //deliveries with same name will be placed together in the vector
     struct DeliveryGroup
     {
@@ -27,10 +567,10 @@ private:
     };
     void swap(vector<DeliveryGroup>& groups, const int index1, const int index2) const;
     void swap(vector<DeliveryRequest>& deliveries, const int index1, const int index2) const;
-    int randInt(int lowest, int highest) const;     // get a random integer between the supplied bounds
+    int randInt(mt19937_64& generator, int lowest, int highest) const;  // get a random integer between the supplied bounds
 };
 inline
-int DeliveryOptimizerImpl::randInt(int lowest, int highest) const
+int DeliveryOptimizerImpl::randInt(mt19937_64& generator, int lowest, int highest) const
 {
     if (highest < lowest)
     {
@@ -38,8 +578,6 @@ int DeliveryOptimizerImpl::randInt(int lowest, int highest) const
         lowest=highest;
         highest=temp;
     }
-    static random_device rd;
-    static default_random_engine generator(rd());
     uniform_int_distribution<> distro(lowest, highest);
     return distro(generator);
 }
@@ -70,9 +608,15 @@ void DeliveryOptimizerImpl::DeliveryGroup::setAvgPoint()
     s_avgPoint = GeoCoord(latStr, longStr);
 }
 
-DeliveryOptimizerImpl::DeliveryOptimizerImpl(const StreetMap* sm)
+DeliveryOptimizerImpl::DeliveryOptimizerImpl(const StreetMap* sm, const OptimizerOptions& options)
 {
     m_streetmap = sm;
+    m_options = options;
+    if (m_options.starts < 1)
+        m_options.starts = 1;
+    if (m_options.threads < 1)
+        m_options.threads = 1;
+    m_options.exactStops = max(0, min(m_options.exactStops, 16));
 }
 
 DeliveryOptimizerImpl::~DeliveryOptimizerImpl()
@@ -100,11 +644,11 @@ void DeliveryOptimizerImpl::swap(vector<DeliveryRequest> &deliveries, const int
     deliveries[index2] = temp;
 }
 
-double DeliveryOptimizerImpl::calcCurrCrowDistance(const GeoCoord depot, vector<DeliveryRequest>& deliveries) const
+double DeliveryOptimizerImpl::calcCurrCrowDistance(const GeoCoord& start, vector<DeliveryRequest>& deliveries, const GeoCoord& end) const
 {
-    //this function calculates the distance, for N deliveries, in the path: depot -> delivery1 -> delivery2 -> ... ->deliveryN->depot
-    GeoCoord startCoord = depot;
-    GeoCoord endCoord;
+    //this function calculates the distance, for N deliveries, in the path: start -> delivery1 -> delivery2 -> ... ->deliveryN->end
+    GeoCoord startCoord = start;
+    GeoCoord endCoord = start;
     double newCrowDis=0;
     for (int i=0; i<deliveries.size(); i++)
     {
@@ -112,7 +656,7 @@ double DeliveryOptimizerImpl::calcCurrCrowDistance(const GeoCoord depot, vector<
         newCrowDis+= distanceEarthMiles(startCoord, endCoord);
         startCoord = endCoord;
     }
-    newCrowDis += distanceEarthMiles(endCoord, depot);
+    newCrowDis += distanceEarthMiles(endCoord, end);
     return newCrowDis;
 }
 
@@ -125,53 +669,136 @@ void DeliveryOptimizerImpl::swap(vector<DeliveryGroup>& groups, const int index1
     groups[index2] = temp;
 }
 
-void DeliveryOptimizerImpl::optimizeDeliveryOrder(
-    const GeoCoord& depot,
-    vector<DeliveryRequest>& deliveries,
-    double& oldCrowDistance,
-    double& newCrowDistance) const
+void DeliveryOptimizerImpl::reportProgress(int cluster, int startIndex, long long evaluations,
+                                           chrono::steady_clock::time_point started, double bestDistance) const
 {
-    if (deliveries.empty())
+    if (!m_options.progress)
         return;
+    OptimizerProgress progress;
+    progress.cluster = cluster;
+    progress.start = startIndex;
+    progress.evaluations = evaluations;
+    progress.elapsedSeconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    progress.bestDistance = bestDistance;
+    lock_guard<mutex> lock(m_progressMutex);
+    m_options.progress(progress);
+}
+
+void DeliveryOptimizerImpl::search(const GeoCoord& from, const GeoCoord& to, vector<DeliveryRequest> deliveries,
+                                   long long evaluationBudget, double timeShare, int cluster, int startIndex,
+                                   chrono::steady_clock::time_point started, SearchResult& result) const
+{
+    seed_seq seq = { (unsigned)m_options.seed, (unsigned)(m_options.seed >> 32),
+                     (unsigned)(cluster*m_options.starts + startIndex) };
+    mt19937_64 generator(seq);
+    long long evaluations = 0;
+    double newCrowDistance;
     
-    oldCrowDistance = calcCurrCrowDistance(depot, deliveries);
-    
-    //get the average distances from the depot
+    //get the average distances from where the path starts
     double averageDistance=0, totalDistance=0;
     for (int i=0; i<deliveries.size(); i++)
-        totalDistance += distanceEarthMiles(depot, deliveries[i].location);
+        totalDistance += distanceEarthMiles(from, deliveries[i].location);
     averageDistance = totalDistance/deliveries.size();
     
     vector<DeliveryRequest> shortestPermutation=deliveries;
 
-    double prevCrowDistance = oldCrowDistance;
+    double prevCrowDistance = calcCurrCrowDistance(from, deliveries, to);
     double temperature;
     double coolingRate = 0.99;
+    double startTemperature = 10000;
     double absoluteTemperature = 0.0001;
     int maxGroupingTrials=5;
     
+    //the temperature falls from startTemperature to absoluteTemperature as the search uses up its budget: without
+    //one, that takes the same number of rounds as cooling by coolingRate; the caller shares an evaluation budget
+    //and the time limit out between the starts, giving this one timeShare seconds from now, and whichever runs
+    //out first ends the search
+    double defaultRounds = ceil(log(absoluteTemperature/startTemperature)/log(coolingRate));
+    bool timed = m_options.timeLimitSeconds > 0;
+    bool budgeted = evaluationBudget > 0 || timed;
+    chrono::steady_clock::time_point began = chrono::steady_clock::now();
+    
+    //a path built by constructOrder has already been tightened by LocalSearch, and shuffling it would only throw
+    //that away, so it is searched around instead: see below
+    int n = (int)deliveries.size();
+    bool constructed = m_options.construction != CONSTRUCT_NONE;
+    unique_ptr<LocalSearch> local;
+    vector<int> bestOrder(n), order, touched(6);
+    if (constructed)
+    {
+        local.reset(new LocalSearch(from, to, deliveries));
+        for (int i=0; i<n; i++)
+            bestOrder[i] = i;
+    }
+    double bestLength = constructed ? local->length(bestOrder) : 0;
     
-    for (temperature=10000; temperature > absoluteTemperature; temperature*=coolingRate)
+    for (long long round=0; ; round++)
     {
-        //randomly shuffle the elements
-        for (int i=0; i<deliveries.size(); i++)
-            swap(deliveries, i, randInt(0, (int)deliveries.size()-1));
+        double used = budgeted ? 0 : round/defaultRounds;  //fraction of the budget used so far
+        if (evaluationBudget > 0)
+            used = max(used, (double)evaluations/evaluationBudget);
+        if (timed)
+            used = max(used, timeShare > 0 ? chrono::duration<double>(chrono::steady_clock::now() - began).count()
+                                               / timeShare : 1);
+        if (used >= 1)
+            break;
+        temperature = startTemperature * pow(absoluteTemperature/startTemperature, used);
+        double heat = log(temperature/absoluteTemperature)/log(startTemperature/absoluteTemperature);
+        
+        if (constructed)
+        {
+            //cut the best path so far in three places and swap the two stretches between the cuts (a double
+            //bridge, which no single 2-opt or Or-opt move undoes), tighten the path again around the cuts and
+            //keep it if it is shorter; the hotter the search, the longer the stretches can be
+            if (n < 3)
+                break;
+            int span = max(1, (int)ceil(heat * n / 3));
+            int first = randInt(generator, 0, n-2);
+            int middle = first + randInt(generator, 1, min(span, n-1-first));
+            int last = middle + randInt(generator, 1, min(span, n-middle));
+            order = bestOrder;
+            rotate(order.begin() + first, order.begin() + middle, order.begin() + last);
+            int seam = first + (last - middle);
+            int cuts[] = { first-1, first, seam-1, seam, last-1, last };
+            touched.assign(cuts, cuts + 6);
+            local->improve(order, touched);
+            evaluations++;
+            double length = local->length(order);
+            if (length < bestLength - 1e-9)
+            {
+                bestOrder.swap(order);
+                bestLength = length;
+                reportProgress(cluster, startIndex, evaluations, started, bestLength);
+            }
+            continue;
+        }
+        
+        //perturb the best order found so far; the hotter the search, the more of it gets shuffled, so early rounds
+        //roam freely and late ones only make small changes around the best order
+        int numSwaps = max(1, (int)ceil(heat*deliveries.size()));
+        deliveries = shortestPermutation;
+        for (int i=0; i<numSwaps; i++)
+            swap(deliveries, randInt(generator, 0, (int)deliveries.size()-1), randInt(generator, 0, (int)deliveries.size()-1));
         
         //recalculate the crow distance
-        newCrowDistance = calcCurrCrowDistance(depot, deliveries);
+        newCrowDistance = calcCurrCrowDistance(from, deliveries, to);
+        evaluations++;
         
         //check if the random arrangement is somehow better
         if (newCrowDistance<prevCrowDistance)
         {
             shortestPermutation=deliveries;
             prevCrowDistance = newCrowDistance;
+            reportProgress(cluster, startIndex, evaluations, started, prevCrowDistance);
         }
         
         //group elements based on different radii for certain numbers of times
         for (int numTrials=0; numTrials<maxGroupingTrials; numTrials++)
         {
+            if (evaluationBudget > 0 && evaluations >= evaluationBudget)
+                break;
             
-            int groupingRadius = randInt(0, averageDistance);
+            int groupingRadius = randInt(generator, 0, averageDistance);
             double currDist = 0;
             vector<DeliveryGroup> groups;
             GeoCoord currCoord;
@@ -208,11 +835,11 @@ void DeliveryOptimizerImpl::optimizeDeliveryOrder(
             //order the groups based on their distances from the center
             for (int i=0; i<groups.size(); i++)
             {
-                double minDist = distanceEarthMiles(depot, groups[i].s_avgPoint);
+                double minDist = distanceEarthMiles(from, groups[i].s_avgPoint);
                 int minIndex = i;
                 for (int j=i+1; j<groups.size(); j++)
                 {
-                    double currDist = distanceEarthMiles(depot, groups[j].s_avgPoint);
+                    double currDist = distanceEarthMiles(from, groups[j].s_avgPoint);
                     if (currDist<minDist)
                     {
                         minDist = currDist;
@@ -229,22 +856,681 @@ void DeliveryOptimizerImpl::optimizeDeliveryOrder(
             
             //better optimization when deliveries at the same location are together
             putSameLocDeliveriesTogether(deliveries);
-            newCrowDistance = calcCurrCrowDistance(depot, deliveries);
+            newCrowDistance = calcCurrCrowDistance(from, deliveries, to);
+            evaluations++;
             
             //consider if the new arrangement is better than before
             if (newCrowDistance<prevCrowDistance)
             {
                 shortestPermutation=deliveries;
                 prevCrowDistance = newCrowDistance;
+                reportProgress(cluster, startIndex, evaluations, started, prevCrowDistance);
             }
             
         }
     }
     
-    deliveries = shortestPermutation;
+    if (constructed)
+    {
+        for (int i=0; i<n; i++)
+            shortestPermutation[i] = deliveries[bestOrder[i]];
+        prevCrowDistance = calcCurrCrowDistance(from, shortestPermutation, to);
+    }
+    result.s_order = shortestPermutation;
+    result.s_distance = prevCrowDistance;
+    result.s_evaluations = evaluations;
+}
+
+void DeliveryOptimizerImpl::makeClusters(const GeoCoord& depot, const vector<DeliveryRequest>& deliveries,
+                                         vector<Cluster>& clusters) const
+{
+    //put the stops in order along a Hilbert curve and cut that into runs of about clusterSize; stops in a run are
+    //close together, and so are the last stop of a run and the first of the next
+    vector<int> curve;
+    hilbertOrder(deliveries, curve);
+    
+    int numClusters = ((int)deliveries.size() + m_options.clusterSize - 1) / m_options.clusterSize;
+    vector<int> firsts;                                 //where each run starts along the curve
+    for (int c=0; c<numClusters; c++)
+    {
+        int first = (int)((long long)deliveries.size() * c / numClusters);
+        while (!firsts.empty() && first > firsts.back() && first < (int)deliveries.size() &&
+               deliveries[curve[first]].location == deliveries[curve[first-1]].location)
+            first++;                                    //keep deliveries to the same place in one cluster
+        if (first < (int)deliveries.size() && (firsts.empty() || first > firsts.back()))
+            firsts.push_back(first);
+    }
+    firsts.push_back((int)deliveries.size());
+    numClusters = (int)firsts.size() - 1;
+    
+    //the runs go round in a loop; break it where going out to the depot and back costs the least extra
+    int breakAt = 0;
+    double leastExtra = 0;
+    for (int c=0; c<numClusters; c++)
+    {
+        const GeoCoord& before = deliveries[curve[(c > 0 ? firsts[c] : firsts[numClusters]) - 1]].location;
+        const GeoCoord& after = deliveries[curve[firsts[c]]].location;
+        double extra = distanceEarthMiles(before, depot) + distanceEarthMiles(depot, after) - distanceEarthMiles(before, after);
+        if (c == 0 || extra < leastExtra)
+        {
+            breakAt = c;
+            leastExtra = extra;
+        }
+    }
+    
+    clusters.clear();
+    clusters.resize(numClusters);
+    for (int i=0; i<numClusters; i++)
+    {
+        int c = (breakAt + i) % numClusters;
+        Cluster& cluster = clusters[i];
+        for (int k=firsts[c]; k<firsts[c+1]; k++)
+            cluster.s_deliveries.push_back(deliveries[curve[k]]);
+        cluster.s_from = i > 0 ? clusters[i-1].s_deliveries.back().location : depot;
+        cluster.s_to = i+1 < numClusters ? deliveries[curve[firsts[(c+1) % numClusters]]].location : depot;
+    }
+}
+
+void DeliveryOptimizerImpl::nearestNeighbourOrder(const GeoCoord& from, const vector<DeliveryRequest>& deliveries,
+                                                  vector<int>& order) const
+{
+    //always on to the nearest stop not yet visited
+    vector<GeoCoord> points;
+    for (int i=0; i<(int)deliveries.size(); i++)
+        points.push_back(deliveries[i].location);
+    StopGrid grid(points);
+    GeoCoord here = from;
+    order.clear();
+    for (int i=0; i<(int)deliveries.size(); i++)
+    {
+        int next = grid.nearest(here);
+        grid.remove(next);
+        order.push_back(next);
+        here = deliveries[next].location;
+    }
+}
+
+void DeliveryOptimizerImpl::greedyEdgeOrder(const GeoCoord& from, const vector<DeliveryRequest>& deliveries,
+                                            vector<int>& order) const
+{
+    //take links between stops shortest first, from each stop's few nearest, leaving out any that would give a stop
+    //a third link or close a loop; that leaves a set of paths, which are joined up nearest end first from the start
+    const int candidates = 8;
+    int n = (int)deliveries.size();
+    vector<GeoCoord> points;
+    for (int i=0; i<n; i++)
+        points.push_back(deliveries[i].location);
+    StopGrid grid(points);
+    vector<pair<double, pair<int, int> > > links;
+    vector<int> near;
+    for (int i=0; i<n; i++)
+    {
+        grid.nearest(i, candidates, near);
+        for (int k=0; k<(int)near.size(); k++)
+            links.push_back(make_pair(grid.distance(i, near[k]), make_pair(min(i, near[k]), max(i, near[k]))));
+    }
+    sort(links.begin(), links.end());
+    links.erase(unique(links.begin(), links.end()), links.end());
+    
+    vector<int> group(n), linked[2] = { vector<int>(n, -1), vector<int>(n, -1) };
+    for (int i=0; i<n; i++)
+        group[i] = i;
+    auto findGroup = [&](int i) {
+        while (group[i] != i)
+            i = group[i] = group[group[i]];
+        return i;
+    };
+    for (int k=0; k<(int)links.size(); k++)
+    {
+        int a = links[k].second.first, b = links[k].second.second;
+        if (linked[1][a] != -1 || linked[1][b] != -1 || findGroup(a) == findGroup(b))
+            continue;
+        group[findGroup(a)] = findGroup(b);
+        linked[linked[0][a] == -1 ? 0 : 1][a] = b;
+        linked[linked[0][b] == -1 ? 0 : 1][b] = a;
+    }
+    
+    for (int i=0; i<n; i++)                         //only the ends of the paths are left to look up
+        if (linked[1][i] != -1)
+            grid.remove(i);
+    GeoCoord here = from;
+    order.clear();
+    while ((int)order.size() < n)
+    {
+        int end = grid.nearest(here);
+        int previous = -1;
+        for (int node = end; node != -1; )
+        {
+            order.push_back(node);
+            int next = linked[0][node] != previous ? linked[0][node] : linked[1][node];
+            previous = node;
+            node = next;
+        }
+        grid.remove(end);
+        if (previous != end)
+            grid.remove(previous);
+        here = deliveries[previous].location;
+    }
+}
+
+void DeliveryOptimizerImpl::curveOrder(const GeoCoord& from, const GeoCoord& to,
+                                       const vector<DeliveryRequest>& deliveries, vector<int>& order) const
+{
+    //the order along a Hilbert curve, treated as a loop and broken, in whichever direction, where getting on at
+    //one end and off at the other costs the least
+    vector<int> curve;
+    hilbertOrder(deliveries, curve);
+    int n = (int)curve.size();
+    int breakAt = 0;
+    bool backwards = false;
+    double leastExtra = numeric_limits<double>::infinity();
+    for (int i=0; i<n; i++)
+    {
+        const GeoCoord& a = deliveries[curve[(i + n - 1) % n]].location;
+        const GeoCoord& b = deliveries[curve[i]].location;
+        double between = distanceEarthMiles(a, b);
+        double forwardExtra = distanceEarthMiles(from, b) + distanceEarthMiles(a, to) - between;
+        double backwardExtra = distanceEarthMiles(from, a) + distanceEarthMiles(b, to) - between;
+        if (forwardExtra < leastExtra)
+        {
+            breakAt = i;
+            backwards = false;
+            leastExtra = forwardExtra;
+        }
+        if (backwardExtra < leastExtra)
+        {
+            breakAt = i;
+            backwards = true;
+            leastExtra = backwardExtra;
+        }
+    }
+    order.clear();
+    for (int k=0; k<n; k++)
+        order.push_back(backwards ? curve[(breakAt - 1 - k + 2*n) % n] : curve[(breakAt + k) % n]);
+}
+
+void DeliveryOptimizerImpl::constructOrder(const GeoCoord& from, const GeoCoord& to,
+                                           vector<DeliveryRequest>& deliveries) const
+{
+    //build an order with every heuristic asked for and keep the shortest, or the order given if that is shorter
+    TourConstruction construction = m_options.construction;
+    if (construction == CONSTRUCT_NONE || deliveries.size() < 3)
+        return;
+    vector<DeliveryRequest> best = deliveries;
+    double bestDistance = calcCurrCrowDistance(from, deliveries, to);
+    for (int heuristic = CONSTRUCT_NEAREST_NEIGHBOUR; heuristic <= CONSTRUCT_SPACE_FILLING_CURVE; heuristic++)
+    {
+        if (construction != CONSTRUCT_BEST && construction != heuristic)
+            continue;
+        vector<int> order;
+        if (heuristic == CONSTRUCT_NEAREST_NEIGHBOUR)
+            nearestNeighbourOrder(from, deliveries, order);
+        else if (heuristic == CONSTRUCT_GREEDY_EDGE)
+            greedyEdgeOrder(from, deliveries, order);
+        else
+            curveOrder(from, to, deliveries, order);
+        vector<DeliveryRequest> built;
+        built.reserve(order.size());
+        for (int i=0; i<(int)order.size(); i++)
+            built.push_back(deliveries[order[i]]);
+        double distance = calcCurrCrowDistance(from, built, to);
+        if (distance < bestDistance)
+        {
+            best.swap(built);
+            bestDistance = distance;
+        }
+    }
+    deliveries.swap(best);
+}
+
+void DeliveryOptimizerImpl::tightenOrder(const GeoCoord& from, const GeoCoord& to,
+                                         vector<DeliveryRequest>& deliveries) const
+{
+    vector<int> order(deliveries.size());
+    for (int i=0; i<(int)order.size(); i++)
+        order[i] = i;
+    LocalSearch(from, to, deliveries).improve(order);
+    vector<DeliveryRequest> tightened;
+    tightened.reserve(deliveries.size());
+    for (int i=0; i<(int)order.size(); i++)
+        tightened.push_back(deliveries[order[i]]);
+    deliveries.swap(tightened);
+}
+
+bool DeliveryOptimizerImpl::orderExactly(const GeoCoord& from, const GeoCoord& to,
+                                         const vector<DeliveryRequest>& deliveries, SearchResult& result) const
+{
+    //deliveries to the same place are made one after another, so only the order of the places matters
+    vector<GeoCoord> places;
+    vector<int> placeOf(deliveries.size());
+    for (int i=0; i<(int)deliveries.size(); i++)
+    {
+        int p = 0;
+        while (p < (int)places.size() && !(places[p] == deliveries[i].location))
+            p++;
+        if (p == (int)places.size())
+        {
+            if ((int)places.size() == m_options.exactStops)
+                return false;
+            places.push_back(deliveries[i].location);
+        }
+        placeOf[i] = p;
+    }
+    int n = (int)places.size();
+    if (n == 0)
+        return false;
+    
+    double between[16][16], fromStart[16], toEnd[16];
+    for (int p=0; p<n; p++)
+    {
+        fromStart[p] = distanceEarthMiles(from, places[p]);
+        toEnd[p] = distanceEarthMiles(places[p], to);
+        for (int q=0; q<n; q++)
+            between[p][q] = distanceEarthMiles(places[p], places[q]);
+    }
+    
+    //Held and Karp's dynamic program: cost[set*n + last] is the length of the shortest path from the start through
+    //every place in set, ending at last (which is in set), and previous holds the place before last on it
+    const double unreached = numeric_limits<double>::infinity();
+    vector<double> cost((size_t)n << n, unreached);
+    vector<signed char> previous((size_t)n << n, -1);
+    for (int p=0; p<n; p++)
+        cost[((size_t)1 << p)*n + p] = fromStart[p];
+    long long evaluations = 0;
+    for (unsigned set=1; set < (1u << n); set++)
+        for (int last=0; last<n; last++)
+        {
+            double here = cost[(size_t)set*n + last];
+            if (here == unreached)
+                continue;
+            for (int next=0; next<n; next++)
+            {
+                if (set & (1u << next))
+                    continue;
+                size_t state = (size_t)(set | (1u << next))*n + next;
+                double through = here + between[last][next];
+                evaluations++;
+                if (through < cost[state])
+                {
+                    cost[state] = through;
+                    previous[state] = (signed char)last;
+                }
+            }
+        }
+    
+    unsigned all = (1u << n) - 1;
+    int last = 0;
+    for (int p=1; p<n; p++)
+        if (cost[(size_t)all*n + p] + toEnd[p] < cost[(size_t)all*n + last] + toEnd[last])
+            last = p;
+    vector<int> placeOrder;
+    for (unsigned set = all; last != -1; )
+    {
+        placeOrder.push_back(last);
+        int before = previous[(size_t)set*n + last];
+        set &= ~(1u << last);
+        last = before;
+    }
+    
+    result.s_order.clear();
+    for (int k=(int)placeOrder.size()-1; k>=0; k--)
+        for (int i=0; i<(int)deliveries.size(); i++)
+            if (placeOf[i] == placeOrder[k])
+                result.s_order.push_back(deliveries[i]);
+    result.s_distance = calcCurrCrowDistance(from, result.s_order, to);
+    result.s_evaluations = evaluations;
+    return true;
+}
+
+static const int DENSE_BOUND_STOPS = 2000;      //bigger batches take their bound from a sparse graph
+static const int BOUND_NEIGHBOURS = 12;         //nearest stops each stop is linked to in that graph
+static const double SPARSE_BOUND_SPAN = 2;      //most degrees of latitude or longitude the sparse graph may span
+
+double DeliveryOptimizerImpl::crowDistanceBound(const GeoCoord& depot, const vector<DeliveryRequest>& deliveries,
+                                                double bestDistance) const
+{
+    //Held and Karp's 1-tree bound: taking away the depot leaves a tour as a path, which is a spanning tree of the
+    //deliveries, so a minimum spanning tree plus the depot's two shortest links is no longer than any tour; adding
+    //a penalty to every link at a stop doesn't change which tour is shortest but does change the tree, so the
+    //penalties are stepped up at stops with more than two links in the tree and down at its leaves, pushing it
+    //towards being a tour and the bound upwards
+    int n = (int)deliveries.size();
+    vector<double> x(n+1), y(n+1), z(n+1);              //points on a unit sphere, the depot first
+    double minLat = 90, maxLat = -90, minLon = 180, maxLon = -180;
+    for (int i=0; i<=n; i++)
+    {
+        const GeoCoord& gc = i == 0 ? depot : deliveries[i-1].location;
+        double lat = deg2rad(gc.latitude), lon = deg2rad(gc.longitude);
+        x[i] = cos(lat) * cos(lon);
+        y[i] = cos(lat) * sin(lon);
+        z[i] = sin(lat);
+        if (i > 0)
+        {
+            minLat = min(minLat, gc.latitude);
+            maxLat = max(maxLat, gc.latitude);
+            minLon = min(minLon, gc.longitude);
+            maxLon = max(maxLon, gc.longitude);
+        }
+    }
+    const double earthDiameterMiles = 2 * 6371.0 / 1.609344;
+    auto distance = [&](int i, int j)                   //the same as distanceEarthMiles, worked out from the chord
+    {
+        double dx = x[i] - x[j], dy = y[i] - y[j], dz = z[i] - z[j];
+        return earthDiameterMiles * asin(min(1.0, sqrt(dx*dx + dy*dy + dz*dz) / 2));
+    };
+    
+    //a big batch only links each stop to its nearest few, as StopGrid finds them; a pair left out is at least as
+    //far apart as the furthest of either stop's nearest (by StopGrid's flat distance, less a margin for the
+    //flattening), so at least as far as the average of the two, and is given a stand-in link that long; the stop
+    //whose half of that, with its penalty, is least is at least as close to any two stops, by the stand-ins, as
+    //they are to each other, so only the stand-ins to it are needed for a minimum spanning tree, which is then
+    //no longer than the real one
+    bool sparse = n > DENSE_BOUND_STOPS && maxLat - minLat <= SPARSE_BOUND_SPAN && maxLon - minLon <= SPARSE_BOUND_SPAN;
+    vector<pair<int, int> > links;                      //each linked pair of stops once
+    vector<double> reach(n+1);                          //no stop left out of a stop's links is nearer than this
+    if (sparse)
+    {
+        vector<GeoCoord> points(n);
+        for (int i=0; i<n; i++)
+            points[i] = deliveries[i].location;
+        StopGrid grid(points);
+        double farLat = deg2rad(max(fabs(minLat), fabs(maxLat))), midLat = deg2rad((minLat + maxLat) / 2);
+        double degreeMiles = earthDiameterMiles / 2 * deg2rad(1);
+        double margin = 0.95 * min(1.0, min(degreeMiles / 69.0, degreeMiles * cos(farLat) / (69.172 * cos(midLat))));
+        vector<vector<int> > nearest(n);
+        for (int i=0; i<n; i++)
+            grid.nearest(i, BOUND_NEIGHBOURS, nearest[i]);
+        for (int i=0; i<n; i++)
+        {
+            reach[i+1] = margin * grid.distance(i, nearest[i].back());
+            for (int k=0; k<(int)nearest[i].size(); k++)
+            {
+                int j = nearest[i][k];
+                if (i < j || find(nearest[j].begin(), nearest[j].end(), i) == nearest[j].end())
+                    links.push_back(make_pair(i+1, j+1));
+            }
+        }
+    }
+    
+    //each round is a minimum spanning tree over the links, so fewer rounds are taken for bigger batches
+    long long linkCount = sparse ? (long long)links.size() + n : (long long)n * n;
+    int rounds = (int)max(1LL, min(100LL, (sparse ? 2000000LL : 20000000LL) / linkCount));
+    vector<double> penalty(n+1, 0), key(n+1);
+    vector<int> parent(n+1), degree(n+1), sets(n+1);
+    vector<bool> inTree(n+1);
+    vector<pair<double, int> > events;                  //a link, or the index -stop for a stop's stand-in
+    auto root = [&](int i)
+    {
+        while (sets[i] != i)
+            i = sets[i] = sets[sets[i]];
+        return i;
+    };
+    double best = 0, stepScale = 2;
+    for (int round=0; round<rounds; round++)
+    {
+        fill(degree.begin(), degree.end(), 0);
+        double length = 0;
+        if (sparse)
+        {
+            //Kruskal's algorithm over the links and the stand-ins, shortest first
+            int hub = 1;
+            for (int i=2; i<=n; i++)
+                if (reach[i] / 2 + penalty[i] < reach[hub] / 2 + penalty[hub])
+                    hub = i;
+            events.clear();
+            for (int k=0; k<(int)links.size(); k++)
+                events.push_back(make_pair(distance(links[k].first, links[k].second) + penalty[links[k].first]
+                                           + penalty[links[k].second], k));
+            for (int i=1; i<=n; i++)
+                if (i != hub)
+                    events.push_back(make_pair((reach[i] + reach[hub]) / 2 + penalty[i] + penalty[hub], -i));
+            sort(events.begin(), events.end());
+            for (int i=1; i<=n; i++)
+                sets[i] = i;
+            for (int k=0, joined=0; k<(int)events.size() && joined<n-1; k++)
+            {
+                int a = events[k].second >= 0 ? links[events[k].second].first : -events[k].second;
+                int b = events[k].second >= 0 ? links[events[k].second].second : hub;
+                int ra = root(a), rb = root(b);
+                if (ra == rb)
+                    continue;
+                sets[max(ra, rb)] = min(ra, rb);
+                length += events[k].first;
+                degree[a]++;
+                degree[b]++;
+                joined++;
+            }
+        }
+        else
+        {
+            //Prim's algorithm over every pair of stops
+            fill(inTree.begin(), inTree.end(), false);
+            fill(key.begin(), key.end(), numeric_limits<double>::infinity());
+            key[1] = 0;
+            parent[1] = -1;
+            for (int added=0; added<n; added++)
+            {
+                int next = -1;
+                for (int i=1; i<=n; i++)
+                    if (!inTree[i] && (next == -1 || key[i] < key[next]))
+                        next = i;
+                inTree[next] = true;
+                length += key[next];
+                if (parent[next] != -1)
+                {
+                    degree[next]++;
+                    degree[parent[next]]++;
+                }
+                for (int i=1; i<=n; i++)
+                    if (!inTree[i])
+                    {
+                        double link = distance(next, i) + penalty[next] + penalty[i];
+                        if (link < key[i])
+                        {
+                            key[i] = link;
+                            parent[i] = next;
+                        }
+                    }
+            }
+        }
+        
+        //then the depot's two cheapest links
+        int first = 1, second = n > 1 ? 2 : 1;
+        vector<double> depotLink(n+1);
+        for (int i=1; i<=n; i++)
+            depotLink[i] = distance(0, i) + penalty[i];
+        if (depotLink[second] < depotLink[first])
+            std::swap(first, second);
+        for (int i=3; i<=n; i++)
+            if (depotLink[i] < depotLink[first])
+            {
+                second = first;
+                first = i;
+            }
+            else if (depotLink[i] < depotLink[second])
+                second = i;
+        length += depotLink[first] + depotLink[second];
+        degree[first]++;
+        degree[second]++;
+        
+        double penaltyTotal = 0;
+        for (int i=1; i<=n; i++)
+            penaltyTotal += penalty[i];
+        best = max(best, length - 2*penaltyTotal);
+        
+        double norm = 0;
+        for (int i=1; i<=n; i++)
+            norm += (degree[i] - 2) * (degree[i] - 2);
+        if (norm == 0 || best >= bestDistance)          //the tree is a tour, so nothing is shorter
+            break;
+        double step = stepScale * (bestDistance - best) / norm;
+        for (int i=1; i<=n; i++)
+            penalty[i] += step * (degree[i] - 2);
+        stepScale *= 0.9;
+    }
+    return min(best, bestDistance);
+}
+
+void DeliveryOptimizerImpl::optimizeDeliveryOrder(
+    const GeoCoord& depot,
+    vector<DeliveryRequest>& deliveries,
+    double& oldCrowDistance,
+    double& newCrowDistance,
+    double* lowerBound) const
+{
+    if (deliveries.empty())
+    {
+        if (lowerBound != nullptr)
+            *lowerBound = 0;
+        return;
+    }
+    
+    oldCrowDistance = calcCurrCrowDistance(depot, deliveries, depot);
     
-    //get final crow distance 
-    newCrowDistance = calcCurrCrowDistance(depot, deliveries);
+    //a batch of up to SMALL_BATCH deliveries is ordered by trying every order, which is quicker than setting up
+    //any search and takes microseconds
+    if ((int)deliveries.size() <= min(SMALL_BATCH, m_options.exactStops))
+    {
+        long long evaluations = 0;
+        switch (deliveries.size())
+        {
+            case 1: newCrowDistance = orderSmallBatch<1>(depot, deliveries, evaluations); break;
+            case 2: newCrowDistance = orderSmallBatch<2>(depot, deliveries, evaluations); break;
+            case 3: newCrowDistance = orderSmallBatch<3>(depot, deliveries, evaluations); break;
+            case 4: newCrowDistance = orderSmallBatch<4>(depot, deliveries, evaluations); break;
+            case 5: newCrowDistance = orderSmallBatch<5>(depot, deliveries, evaluations); break;
+            case 6: newCrowDistance = orderSmallBatch<6>(depot, deliveries, evaluations); break;
+            case 7: newCrowDistance = orderSmallBatch<7>(depot, deliveries, evaluations); break;
+            case 8: newCrowDistance = orderSmallBatch<8>(depot, deliveries, evaluations); break;
+        }
+        STATS_COUNT(optimizerIterations, evaluations);
+        if (lowerBound != nullptr)
+            *lowerBound = newCrowDistance;
+        return;
+    }
+    
+    //a big batch is cut into clusters whose paths are found on their own, from the stop before them to the stop
+    //after them in the order the clusters are visited, and then put one after another
+    chrono::steady_clock::time_point started = chrono::steady_clock::now();
+    vector<Cluster> clusters;
+    if (m_options.clusterSize > 0 && (int)deliveries.size() > m_options.clusterSize)
+        makeClusters(depot, deliveries, clusters);
+    else
+    {
+        clusters.resize(1);
+        clusters[0].s_from = depot;
+        clusters[0].s_to = depot;
+        clusters[0].s_deliveries = deliveries;
+    }
+    
+    //runs work(0) .. work(count-1) on up to m_options.threads threads, the calling thread taking its share too;
+    //each thread takes every numThreads-th task, in order
+    auto runTasks = [&](int count, const function<void(int first, int numThreads)>& work)
+    {
+        int numThreads = max(1, min(m_options.threads, count));
+        vector<thread> workers;
+        for (int t=1; t<numThreads; t++)
+            workers.push_back(thread(work, t, numThreads));
+        work(0, numThreads);
+        for (int t=0; t<(int)workers.size(); t++)
+            workers[t].join();
+    };
+    
+    //first every cluster is either ordered exactly, once, in the place of its first start, or given the best
+    //order a heuristic builds to start the search from; joining clusters up can lose to an order built over the
+    //whole batch at once, so that is built alongside them
+    vector<SearchResult> results(clusters.size() * m_options.starts);
+    vector<char> exact(clusters.size());
+    vector<DeliveryRequest> whole;
+    int wholeTask = clusters.size() > 1 ? (int)clusters.size() : -1;
+    runTasks((int)clusters.size() + (wholeTask != -1), [&](int first, int numThreads)
+    {
+        for (int c=first; c<(int)clusters.size() + (wholeTask != -1); c+=numThreads)
+        {
+            if (c == wholeTask)
+            {
+                whole = deliveries;
+                constructOrder(depot, depot, whole);
+                if (m_options.construction != CONSTRUCT_NONE)
+                    tightenOrder(depot, depot, whole);
+            }
+            else if (!(exact[c] = orderExactly(clusters[c].s_from, clusters[c].s_to, clusters[c].s_deliveries,
+                                               results[c * m_options.starts])))
+            {
+                constructOrder(clusters[c].s_from, clusters[c].s_to, clusters[c].s_deliveries);
+                if (m_options.construction != CONSTRUCT_NONE)
+                    tightenOrder(clusters[c].s_from, clusters[c].s_to, clusters[c].s_deliveries);
+            }
+        }
+    });
+    vector<int> tasks;
+    for (int c=0; c<(int)clusters.size(); c++)
+        for (int s=0; s<m_options.starts && !exact[c]; s++)
+            tasks.push_back(c * m_options.starts + s);
+    
+    //every start is seeded from the options, its cluster and its own index, and the winner in each cluster is picked
+    //by distance and then by index, so the result is the same for a given seed no matter how many threads run the
+    //starts; an evaluation budget is shared out between the clusters by their size, and each thread shares the
+    //time left out between the starts it has still to run the same way, so a start that finishes early leaves its
+    //time to the ones after it
+    chrono::steady_clock::time_point deadline = started + chrono::duration_cast<chrono::steady_clock::duration>(
+                                                    chrono::duration<double>(m_options.timeLimitSeconds));
+    runTasks((int)tasks.size(), [&](int first, int numThreads)
+    {
+        double sizeLeft = 0;                            //stops in the starts this thread has still to run
+        for (int k=first; k<(int)tasks.size(); k+=numThreads)
+            sizeLeft += clusters[tasks[k] / m_options.starts].s_deliveries.size();
+        for (int k=first; k<(int)tasks.size(); k+=numThreads)
+        {
+            int t = tasks[k];
+            const Cluster& cluster = clusters[t / m_options.starts];
+            long long evaluationBudget = 0;
+            if (m_options.maxEvaluations > 0)
+                evaluationBudget = max(1LL, (long long)((double)m_options.maxEvaluations * cluster.s_deliveries.size()
+                                                        / deliveries.size() / m_options.starts));
+            double timeShare = 0;
+            if (m_options.timeLimitSeconds > 0)
+                timeShare = chrono::duration<double>(deadline - chrono::steady_clock::now()).count()
+                            * cluster.s_deliveries.size() / sizeLeft;
+            sizeLeft -= cluster.s_deliveries.size();
+            search(cluster.s_from, cluster.s_to, cluster.s_deliveries, evaluationBudget, timeShare,
+                   t / m_options.starts, t % m_options.starts, started, results[t]);
+        }
+    });
+    
+    vector<DeliveryRequest> order;
+    order.reserve(deliveries.size());
+    for (int c=0; c<(int)clusters.size(); c++)
+    {
+        int best = c * m_options.starts;
+        for (int t=best; t<(exact[c] ? best+1 : (c+1) * m_options.starts); t++)
+        {
+            STATS_COUNT(optimizerIterations, results[t].s_evaluations);
+            if (results[t].s_distance < results[best].s_distance)
+                best = t;
+        }
+        order.insert(order.end(), results[best].s_order.begin(), results[best].s_order.end());
+    }
+    
+    //get final crow distance, and keep the order built over the whole batch if that is shorter; the clusters'
+    //paths were tightened on their own, so the joined order is tightened again across the joins
+    if (wholeTask != -1 && m_options.construction != CONSTRUCT_NONE)
+        tightenOrder(depot, depot, order);
+    newCrowDistance = calcCurrCrowDistance(depot, order, depot);
+    if (wholeTask != -1)
+    {
+        double wholeCrowDistance = calcCurrCrowDistance(depot, whole, depot);
+        if (wholeCrowDistance <= newCrowDistance)
+        {
+            order.swap(whole);
+            newCrowDistance = wholeCrowDistance;
+        }
+    }
+    deliveries = order;
+    
+    if (lowerBound != nullptr)
+        *lowerBound = clusters.size() == 1 && exact[0] ? newCrowDistance
+                                                        : crowDistanceBound(depot, deliveries, newCrowDistance);
 }
 
 //******************** DeliveryOptimizer functions ****************************
@@ -254,7 +1540,12 @@ void DeliveryOptimizerImpl::optimizeDeliveryOrder(
 
 DeliveryOptimizer::DeliveryOptimizer(const StreetMap* sm)
 {
-    m_impl = new DeliveryOptimizerImpl(sm);
+    m_impl = new DeliveryOptimizerImpl(sm, OptimizerOptions());
+}
+
+DeliveryOptimizer::DeliveryOptimizer(const StreetMap* sm, const OptimizerOptions& options)
+{
+    m_impl = new DeliveryOptimizerImpl(sm, options);
 }
 
 DeliveryOptimizer::~DeliveryOptimizer()
@@ -268,5 +1559,15 @@ void DeliveryOptimizer::optimizeDeliveryOrder(
         double& oldCrowDistance,
         double& newCrowDistance) const
 {
-    return m_impl->optimizeDeliveryOrder(depot, deliveries, oldCrowDistance, newCrowDistance);
+    return m_impl->optimizeDeliveryOrder(depot, deliveries, oldCrowDistance, newCrowDistance, nullptr);
+}
+
+void DeliveryOptimizer::optimizeDeliveryOrder(
+        const GeoCoord& depot,
+        vector<DeliveryRequest>& deliveries,
+        double& oldCrowDistance,
+        double& newCrowDistance,
+        double& lowerBound) const
+{
+    return m_impl->optimizeDeliveryOrder(depot, deliveries, oldCrowDistance, newCrowDistance, &lowerBound);
 }
@@ -1,46 +1,77 @@
 #include "provided.h"
+#include "Instrumentation.h"
+#include "StreetGraph.h"
+#include <cmath>
+#include <mutex>
+#include <string>
 #include <vector>
 using namespace std;
 
+  // The names behind one plan's commands: streets come straight from the
+  // version of the map the plan was made on, which the names keep alive, and
+  // items are copied from the delivery requests.
+class PlanNames : public CommandNames
+{
+public:
+    PlanNames(const MapSnapshot& graph, const vector<DeliveryRequest>& stops)
+     : m_graph(graph)
+    {
+        for (int i=0; i<(int)stops.size(); i++)
+            m_items.push_back(stops[i].item);
+    }
+    const char* streetName(int street) const { return m_graph->streetName(street); }
+    const char* itemName(int item) const { return m_items[item].c_str(); }
+private:
+    MapSnapshot m_graph;
+    vector<string> m_items;
+};
+
 class DeliveryPlannerImpl
 {
 public:
-    DeliveryPlannerImpl(const StreetMap* sm);
+    DeliveryPlannerImpl(const StreetMap* sm, const OptimizerOptions& options, RouteCost cost);
     ~DeliveryPlannerImpl();
     DeliveryResult generateDeliveryPlan(
         const GeoCoord& depot,
         const vector<DeliveryRequest>& deliveries,
         vector<DeliveryCommand>& commands,
-        double& totalDistanceTravelled) const;
+        double& totalDistanceTravelled,
+        PlanResult& result) const;
+    DeliveryStats lastPlanStats() const;
+    bool exportPlanGeometry(GeometryFormat format, string& geometry) const;
+    void keepLast(const PlanResult& result) const;
 private:
     const StreetMap* m_streetmap;
-    string getDirName(double angle) const;
-    string getTurnDir(double angle) const;
+    OptimizerOptions m_optimizerOptions;                //passed on to the DeliveryOptimizer for every plan
+    RouteCost m_routeCost;                              //what the router minimizes for every leg
+    mutable mutex m_lastMutex;                          //calls on different threads take turns replacing m_last
+    mutable PlanResult m_last;                          //the result of the call that finished last
+    CompassDirection getDir(double angle) const;
+    TurnDirection getTurnDir(double angle) const;
+    void generateCommands(const MapSnapshot& map, const vector<Route>& legs, const vector<DeliveryRequest>& stops,
+                          vector<DeliveryCommand>& commands, double& totalDistanceTravelled) const;
 };
 
-string DeliveryPlannerImpl::getDirName(double angle) const
+inline
+CompassDirection DeliveryPlannerImpl::getDir(double angle) const
 {
-    if (0<=angle && angle < 22.5) return "east";
-    if (22.5<=angle && angle <67.5) return "northeast";
-    if (67.5<=angle && angle <112.5) return "north";
-    if (112.5<=angle && angle <157.5) return "northwest";
-    if (157.5<=angle && angle <202.5) return "west";
-    if (202.5<=angle && angle <247.5) return "southwest";
-    if (247.5<=angle && angle <292.5) return "south";
-    if (292.5<=angle && angle <337.5) return "southeast";
-    return "east";
+    //each direction covers 45 degrees centred on its own angle, with east wrapping around past 337.5
+    return (CompassDirection)((int)((angle + 22.5) / 45) & 7);
 }
 
-string DeliveryPlannerImpl::getTurnDir(double angle) const
+inline
+TurnDirection DeliveryPlannerImpl::getTurnDir(double angle) const
 {
-    if (angle >=1 && angle< 180) return "left";
-    if (angle >=180 && angle <=359) return "right";
-    else return "";
+    if (angle >=1 && angle< 180) return TURN_LEFT;
+    if (angle >=180 && angle <=359) return TURN_RIGHT;
+    else return TURN_NONE;
 }
 
-DeliveryPlannerImpl::DeliveryPlannerImpl(const StreetMap* sm)
+DeliveryPlannerImpl::DeliveryPlannerImpl(const StreetMap* sm, const OptimizerOptions& options, RouteCost cost)
 {
     m_streetmap = sm;
+    m_optimizerOptions = options;
+    m_routeCost = cost;
 }
 
 DeliveryPlannerImpl::~DeliveryPlannerImpl()
@@ -52,114 +83,236 @@ DeliveryResult DeliveryPlannerImpl::generateDeliveryPlan(
     const GeoCoord& depot,
     const vector<DeliveryRequest>& deliveries,
     vector<DeliveryCommand>& commands,
-    double& totalDistanceTravelled) const
+    double& totalDistanceTravelled,
+    PlanResult& result) const
 {
-    {
-        vector<StreetSegment> temp;
-        if (!m_streetmap->getSegmentsThatStartWith(depot, temp))
+    result = PlanResult();
+    DeliveryStats& stats = result.m_stats;
+    STATS_SCOPE(&stats);
+    STATS_TIMER(totalSeconds);
+    MapSnapshot map = m_streetmap->snapshot();                                         //the whole plan is made on this version
+    const StreetGraph& graph = *map;
+    int depotNode = graph.nodeId(depot);
+    if (depotNode == -1)
+        return BAD_COORD;
+    totalDistanceTravelled = 0;
+    
+    //a batch with a stop that can't be reached from the depot (or the depot from it) can't be delivered, so turn
+    //it down before any optimizing or routing; reporting bad coordinates comes first
+    vector<GeoCoordView> stopCoords;
+    for (int i=0; i<(int)deliveries.size(); i++)
+        stopCoords.push_back(GeoCoordView(deliveries[i].location));
+    vector<int> stopNodes;
+    graph.nodeIds(stopCoords, stopNodes);                                              //looked up as one batch
+    for (int i=0; i<(int)deliveries.size(); i++)
+        if (stopNodes[i] == -1)
             return BAD_COORD;
-    }
+    for (int i=0; i<(int)deliveries.size(); i++)
+        if (graph.component(stopNodes[i]) != graph.component(depotNode))
+            return NO_ROUTE;
+    
+    //on a mapped map, have the parts of the file around every stop paged in while the optimizer works
+    graph.prefetchAround(depotNode);
+    for (int i=0; i<(int)deliveries.size(); i++)
+        graph.prefetchAround(stopNodes[i]);
     
-    GeoCoord startCoord = depot;
-    GeoCoord endCoord;
-    string itemToBeDelivered;
-    PointToPointRouter p2p(m_streetmap);
+    PointToPointRouter p2p(m_streetmap, m_routeCost);
     
     vector<DeliveryRequest> deliverAndReturn = deliveries;                             //this vector will allow changes and can
                                                                                        //allow addition of the depot to the end
-    double oldCrowDist, newCrowDist;
-    DeliveryOptimizer myDO(m_streetmap);
-    myDO.optimizeDeliveryOrder(depot, deliverAndReturn, oldCrowDist, newCrowDist);     //reorder to optimizing the path taken
-    cerr<<"Old distance was: "<<oldCrowDist<<endl;
-    cerr<<"New distance is: " << newCrowDist<<endl;
+    double oldCrowDist = 0, newCrowDist = 0, crowBound = 0;
+    {
+        STATS_TIMER(optimizeSeconds);
+        DeliveryOptimizer myDO(m_streetmap, m_optimizerOptions);
+#ifndef GOOBEREATS_MINIMAL
+        myDO.optimizeDeliveryOrder(depot, deliverAndReturn, oldCrowDist, newCrowDist, crowBound); //reorder to optimizing the path taken
+#else
+        myDO.optimizeDeliveryOrder(depot, deliverAndReturn, oldCrowDist, newCrowDist);    //without stats nobody sees the bound
+#endif
+    }
+    stats.oldCrowDistance = oldCrowDist;
+    stats.newCrowDistance = newCrowDist;
+    stats.crowDistanceBound = crowBound;
+    stats.optimalityGap = crowBound > 0 ? newCrowDist / crowBound - 1 : 0;
     
     deliverAndReturn.push_back(DeliveryRequest("", depot));                            //add the depot to the end of the deliveries
                                                                                        //since we have to return back there
-    string currStreetName="";
-    for (int i=0; i<deliverAndReturn.size(); i++)                                      //for every delivery
+    vector<Route> legs(deliverAndReturn.size());
     {
-        double dist;
-        endCoord = deliverAndReturn[i].location;
-        list<StreetSegment> route;
-        //get route from previous delivery (or depot if its the first delivery) to the current delivery (or depot if its the last delivery)
-        DeliveryResult delRes = p2p.generatePointToPointRoute(startCoord, endCoord, route, dist);
-        if (delRes == NO_ROUTE)
-            return NO_ROUTE;
-        if (delRes == BAD_COORD)
-            return BAD_COORD;
-        
-        itemToBeDelivered = deliverAndReturn[i].item;
-        
-        auto it = route.begin();
-        double currStreetDistance=0;
-        double currStreetAngle=0;
-        
-        for (; ; it++)                                                                  //for every street segment from the depot
+        STATS_TIMER(routeSeconds);
+        GeoCoord startCoord = depot;
+        for (int i=0; i<(int)deliverAndReturn.size(); i++)                             //for every delivery
         {
-            if (currStreetName.empty())                                                 //the street name is empty every time a new street
-                                                                                        //begins which allows resetting the angle the current
-                                                                                        //street starts with
-            {
-                currStreetName = it->name;
-                currStreetAngle = angleOfLine(*it);
-            }
+            //get route from previous delivery (or depot if its the first delivery) to the current delivery (or depot if its the last delivery)
+            DeliveryResult delRes = p2p.generatePointToPointRoute(map, startCoord, deliverAndReturn[i].location, legs[i]);
+            if (delRes != DELIVERY_SUCCESS)
+                return delRes;
+            startCoord = deliverAndReturn[i].location;
+        }
+    }
+    
+    {
+        STATS_TIMER(commandSeconds);
+        generateCommands(map, legs, deliverAndReturn, commands, totalDistanceTravelled);
+    }
+    result.m_map = map;
+    result.m_depotNode = depotNode;
+    result.m_legs.swap(legs);
+    stats.residentBytes = residentSetBytes();
+    return DELIVERY_SUCCESS;
+}
+
+void DeliveryPlannerImpl::generateCommands(const MapSnapshot& map, const vector<Route>& legs,
+                                           const vector<DeliveryRequest>& stops,
+                                           vector<DeliveryCommand>& commands, double& totalDistanceTravelled) const
+{
+    //a single pass over the edges of every leg: each run of edges on the same street becomes a proceed command,
+    //preceded by a turn command when it follows another street on the same leg; the angles and lengths it needs
+    //were worked out once when the map was loaded
+    const StreetGraph& graph = *map;
+    shared_ptr<const CommandNames> names = make_shared<PlanNames>(map, stops);   //shared by every command of the plan
+    for (int i=0; i<(int)legs.size(); i++)
+    {
+        const Route& route = legs[i];
+        int k=0;
+        while (k < route.size())
+        {
+            int runStart = k;
+            int street = graph.edgeStreet(route.edge(k));
+            double streetDistance = 0;
+            for (; k<route.size() && graph.edgeStreet(route.edge(k)) == street; k++)  //find where the street ends
+                streetDistance += graph.edgeLength(route.edge(k));
             
-            if (++it == route.end())                                                    //if the next street segment is denotes a delivery
-            {
-                --it;
-                if (!currStreetName.empty())
-                {
-                    currStreetDistance+= distanceEarthMiles(it->start, it->end);        //add the length of the currect street segment
-                    DeliveryCommand d1;
-                    d1.initAsProceedCommand(getDirName(currStreetAngle), currStreetName, currStreetDistance);
-                    commands.push_back(d1);
-                    totalDistanceTravelled+= currStreetDistance;                        //increase the total distance with the current
-                                                                                        //street's length
-                }
-                if (i!=deliverAndReturn.size()-1)                                       //don't give a delivery command when we reach back to
-                                                                                        //the depot, which is the last element of deliverAndReturn
-                {
-                    DeliveryCommand d2;
-                    d2.initAsDeliverCommand(itemToBeDelivered);
-                    commands.push_back(d2);
-                }
-                currStreetName="";                                                      //reset the name to empty so that a turn command is
-                                                                                        //not issued right after a delivery (i.e. the next if
-                                                                                        //statement is not entered)
-                break;
-            }
-            --it;
-            if (!currStreetName.empty() && currStreetName != it->name)                  //if a new street has begun
+            if (runStart > 0)                                                       //a new street has begun
             {
-                DeliveryCommand d1;
-                d1.initAsProceedCommand(getDirName(currStreetAngle), currStreetName, currStreetDistance); //register a proceed command
-                commands.push_back(d1);
-
-                StreetSegment s1 = *it;
-                it--;
-                StreetSegment s2 = *it;
-                it++;
-                double turnAngle = angleBetween2Lines(s2, s1);                          //calculate the angle between previous and current street
-                DeliveryCommand d;
-                if (!getTurnDir(turnAngle).empty())                                     //if the car is not to travel straight (i.e. turn
-                                                                                        //left or right)
+                double turnAngle = graph.edgeAngle(route.edge(runStart)) - graph.edgeAngle(route.edge(runStart-1));
+                if (turnAngle < 0)
+                    turnAngle += 360;
+                TurnDirection turn = getTurnDir(turnAngle);
+                if (turn != TURN_NONE)                                              //if the car is not to travel straight
                 {
-                    d.initAsTurnCommand(getTurnDir(turnAngle), it->name);               //register a turn command
+                    DeliveryCommand d;
+                    d.initAsTurnCommand(turn, street, names);
                     commands.push_back(d);
                 }
-                totalDistanceTravelled+=currStreetDistance;                             //incremeent total distance by previous steet's length
-                currStreetDistance=0;                                                   //reset current street distance for the new street
-                currStreetAngle = angleOfLine(*it);                                     //reset the starting directin of the current street
-                currStreetName = it->name;                                              //reset the name of the street
             }
-            
-            currStreetDistance+= distanceEarthMiles(it->start, it->end);                //add the distance of the current street segment
+            DeliveryCommand d;
+            d.initAsProceedCommand(getDir(graph.edgeAngle(route.edge(runStart))), street, streetDistance, names);
+            commands.push_back(d);
+            totalDistanceTravelled += streetDistance;
         }
         
-        startCoord = endCoord;                              //shift to the next street segment
-        
+        if (i != (int)legs.size()-1)                                                //don't give a delivery command when we reach back to
+        {                                                                           //the depot, which is the last stop
+            DeliveryCommand d;
+            d.initAsDeliverCommand(i, names);
+            commands.push_back(d);
+        }
     }
-    return DELIVERY_SUCCESS;
+}
+
+void DeliveryPlannerImpl::keepLast(const PlanResult& result) const
+{
+    lock_guard<mutex> lock(m_lastMutex);
+    m_last = result;
+}
+
+DeliveryStats DeliveryPlannerImpl::lastPlanStats() const
+{
+    lock_guard<mutex> lock(m_lastMutex);
+    return m_last.stats();
+}
+
+bool DeliveryPlannerImpl::exportPlanGeometry(GeometryFormat format, string& geometry) const
+{
+    PlanResult last;
+    {
+        lock_guard<mutex> lock(m_lastMutex);
+        last = m_last;                                  //shares its map and copies its legs, so export runs unlocked
+    }
+    return last.exportGeometry(format, geometry);
+}
+
+  // Appends one value of an encoded polyline: the difference from the value
+  // before, shifted left with the sign in the lowest bit, five bits at a time
+  // from the bottom, each with 0x20 set if more follow, offset by 63
+static void appendPolylineValue(string& out, long long delta)
+{
+    unsigned long long v = delta < 0 ? ~((unsigned long long)delta << 1) : (unsigned long long)delta << 1;
+    while (v >= 0x20)
+    {
+        out += (char)((0x20 | (v & 0x1f)) + 63);
+        v >>= 5;
+    }
+    out += (char)(v + 63);
+}
+
+static void appendLittleEndian(string& out, unsigned int v)
+{
+    for (int i=0; i<4; i++)
+        out += (char)((v >> (8*i)) & 0xff);
+}
+
+bool PlanResult::exportGeometry(GeometryFormat format, string& geometry) const
+{
+    geometry.clear();
+    if (!m_map)
+        return false;
+    const StreetGraph& graph = *m_map;
+    
+    //the depot, then the far end of every edge of every leg; each leg starts where the one before it ended
+    vector<int> nodes(1, m_depotNode);
+    for (int i=0; i<(int)m_legs.size(); i++)
+        for (int k=0; k<m_legs[i].size(); k++)
+            nodes.push_back(graph.edgeTo(m_legs[i].edge(k)));
+    
+    if (format == GEOMETRY_POLYLINE)
+    {
+        geometry.reserve(nodes.size() * 6);
+        long long lastLat = 0, lastLon = 0;
+        for (int i=0; i<(int)nodes.size(); i++)
+        {
+            long long lat = llround(graph.latitude(nodes[i]) * 1e5);
+            long long lon = llround(graph.longitude(nodes[i]) * 1e5);
+            appendPolylineValue(geometry, lat - lastLat);
+            appendPolylineValue(geometry, lon - lastLon);
+            lastLat = lat;
+            lastLon = lon;
+        }
+    }
+    else
+    {
+        geometry.reserve(4 + nodes.size() * 8);
+        appendLittleEndian(geometry, (unsigned int)nodes.size());
+        for (int i=0; i<(int)nodes.size(); i++)
+        {
+            appendLittleEndian(geometry, (unsigned int)(int)llround(graph.latitude(nodes[i]) * 1e7));
+            appendLittleEndian(geometry, (unsigned int)(int)llround(graph.longitude(nodes[i]) * 1e7));
+        }
+    }
+    return true;
+}
+
+ostream& operator<<(ostream& os, const DeliveryStats& stats)
+{
+    ostringstream oss;                                  //format separately so the caller's stream flags are left alone
+    oss.precision(6);
+    oss << "{\"totalSeconds\":" << stats.totalSeconds
+        << ",\"optimizeSeconds\":" << stats.optimizeSeconds
+        << ",\"routeSeconds\":" << stats.routeSeconds
+        << ",\"commandSeconds\":" << stats.commandSeconds
+        << ",\"nodesExpanded\":" << stats.nodesExpanded
+        << ",\"hashProbes\":" << stats.hashProbes
+        << ",\"segmentsCopied\":" << stats.segmentsCopied
+        << ",\"optimizerIterations\":" << stats.optimizerIterations
+        << ",\"legsRouted\":" << stats.legsRouted
+        << ",\"arenaBlocks\":" << stats.arenaBlocks
+        << ",\"residentBytes\":" << stats.residentBytes
+        << ",\"oldCrowDistance\":" << stats.oldCrowDistance
+        << ",\"newCrowDistance\":" << stats.newCrowDistance
+        << ",\"crowDistanceBound\":" << stats.crowDistanceBound
+        << ",\"optimalityGap\":" << stats.optimalityGap << "}";
+    return os << oss.str();
 }
 
 //******************** DeliveryPlanner functions ******************************
@@ -169,7 +322,17 @@ DeliveryResult DeliveryPlannerImpl::generateDeliveryPlan(
 
 DeliveryPlanner::DeliveryPlanner(const StreetMap* sm)
 {
-    m_impl = new DeliveryPlannerImpl(sm);
+    m_impl = new DeliveryPlannerImpl(sm, OptimizerOptions(), COST_HOPS);
+}
+
+DeliveryPlanner::DeliveryPlanner(const StreetMap* sm, const OptimizerOptions& options)
+{
+    m_impl = new DeliveryPlannerImpl(sm, options, COST_HOPS);
+}
+
+DeliveryPlanner::DeliveryPlanner(const StreetMap* sm, const OptimizerOptions& options, RouteCost cost)
+{
+    m_impl = new DeliveryPlannerImpl(sm, options, cost);
 }
 
 DeliveryPlanner::~DeliveryPlanner()
@@ -183,5 +346,28 @@ DeliveryResult DeliveryPlanner::generateDeliveryPlan(
     vector<DeliveryCommand>& commands,
     double& totalDistanceTravelled) const
 {
-    return m_impl->generateDeliveryPlan(depot, deliveries, commands, totalDistanceTravelled);
+    PlanResult result;
+    return generateDeliveryPlan(depot, deliveries, commands, totalDistanceTravelled, result);
+}
+
+DeliveryResult DeliveryPlanner::generateDeliveryPlan(
+    const GeoCoord& depot,
+    const vector<DeliveryRequest>& deliveries,
+    vector<DeliveryCommand>& commands,
+    double& totalDistanceTravelled,
+    PlanResult& result) const
+{
+    DeliveryResult delivered = m_impl->generateDeliveryPlan(depot, deliveries, commands, totalDistanceTravelled, result);
+    m_impl->keepLast(result);
+    return delivered;
+}
+
+DeliveryStats DeliveryPlanner::lastPlanStats() const
+{
+    return m_impl->lastPlanStats();
+}
+
+bool DeliveryPlanner::exportPlanGeometry(GeometryFormat format, string& geometry) const
+{
+    return m_impl->exportPlanGeometry(format, geometry);
 }
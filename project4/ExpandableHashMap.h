@@ -4,11 +4,64 @@
 #define ExpandableHashMap_h
 #include <list>
 #include <iostream>
-template<typename KeyType, typename ValueType>
+#include <memory>
+#include <utility>
+#include "Instrumentation.h"
+
+// Hasher is a function object giving an unsigned hash for a key; by default
+// it calls a free function unsigned int hasher(const KeyType&). Every entry
+// keeps its hash, so growing the table never hashes a key again and lookups
+// only compare keys whose hashes match. The number of buckets is always a
+// power of two, so a hash picks its bucket with a mask.
+//
+// The bucket array, the bucket lists and their nodes all come from Allocator,
+// so a map can be pointed at a MonotonicArena (see Arena.h) for scratch use.
+
+  // Asks for the cache line holding p to be loaded, so that a lookup about to
+  // read it finds it there
+inline void prefetchForRead(const void* p)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(p, 0, 3);
+#else
+    (void)p;
+#endif
+}
+
+template<typename KeyType>
+struct DefaultHasher
+{
+    unsigned int operator()(const KeyType& key) const
+    {
+        unsigned int hasher(const KeyType& key);
+        return hasher(key);
+    }
+};
+
+  // For keys that are small ids handed out in sequence, which already spread
+  // evenly over the buckets
+struct IdHasher
+{
+    unsigned int operator()(int id) const { return (unsigned int)id; }
+};
+
+  // How full a map is and how long its buckets have grown
+struct HashMapProbeStats
+{
+    int entries;
+    int buckets;
+    int filledBuckets;
+    int longestBucket;
+    double averageProbes;           //entries compared by a lookup that finds its key, on average over every key
+};
+
+template<typename KeyType, typename ValueType, typename Hasher = DefaultHasher<KeyType>,
+         typename Allocator = std::allocator<std::pair<const KeyType, ValueType>>>
 class ExpandableHashMap
 {
 public:
-    ExpandableHashMap(double maximumLoadFactor = 0.5);
+    ExpandableHashMap(double maximumLoadFactor = 0.5, const Allocator& alloc = Allocator(),
+                      const Hasher& hash = Hasher());
     ~ExpandableHashMap();
     void reset();
     int size() const;
@@ -18,6 +71,18 @@ public:
     {
         return const_cast<ValueType*>(const_cast<const ExpandableHashMap*>(this)->find(key));
     }
+      // finds any key type that Hasher can hash and KeyType compares equal to,
+      // without building a KeyType from it
+    template<typename LookupKey>
+    const ValueType* findAs(const LookupKey& key) const
+    {
+        return findHashed(key, m_hash(key));
+    }
+      // results[i] = find(keys[i]) for count keys; a few keys at a time are
+      // hashed and their slots in the table fetched before any of them is
+      // searched
+    void findMany(const KeyType* keys, int count, const ValueType** results) const;
+    HashMapProbeStats probeStats() const;
     ExpandableHashMap(const ExpandableHashMap&) = delete;
     ExpandableHashMap& operator=(const ExpandableHashMap&) = delete;
 
@@ -26,18 +91,33 @@ private:
     {
         KeyType k;
         ValueType v;
+        unsigned int h;             //hash of k
     };
+    typedef std::allocator_traits<Allocator> AllocTraits;
+    typedef typename AllocTraits::template rebind_alloc<Node> NodeAllocator;
+    typedef std::list<Node, NodeAllocator> Bucket;
+    typedef typename AllocTraits::template rebind_alloc<Bucket> BucketAllocator;
+    typedef typename AllocTraits::template rebind_alloc<Bucket*> TableAllocator;
     
     double m_maxLoadFactor;         //stores the maximum load factor
     int m_nSlots;                   //stores the total buckets available, both filled and unfilled
-    std::list<Node>** m_hashTable;  //stores the pointer to the hash table which is an array of buckets of pointers to lists
+    Bucket** m_hashTable;           //stores the pointer to the hash table which is an array of buckets of pointers to lists
     int m_filledBuckets;            //stores the number of filled buckets
     int m_associations;             //stores the number of Nodes inserted in the hash table
+    Allocator m_alloc;              //where the table, the buckets and their nodes are allocated from
+    Hasher m_hash;
     
+    Bucket** newTable(int nSlots);                      //an array of nSlots empty (nullptr) buckets
+    void deleteTable(Bucket** table, int nSlots);       //destroys the buckets and then the array itself
+    Bucket* newBucket();
+    template<typename LookupKey>
+    const ValueType* findHashed(const LookupKey& key, unsigned int h) const;
 };
 
-template<typename KeyType, typename ValueType>
-ExpandableHashMap<KeyType, ValueType>::ExpandableHashMap(double maximumLoadFactor)
+template<typename KeyType, typename ValueType, typename Hasher, typename Allocator>
+ExpandableHashMap<KeyType, ValueType, Hasher, Allocator>::ExpandableHashMap(double maximumLoadFactor, const Allocator& alloc,
+                                                                        const Hasher& hash)
+ : m_alloc(alloc), m_hash(hash)
 {
     if (maximumLoadFactor > 0 && maximumLoadFactor <= 1)
         m_maxLoadFactor = maximumLoadFactor;
@@ -45,62 +125,90 @@ ExpandableHashMap<KeyType, ValueType>::ExpandableHashMap(double maximumLoadFacto
         m_maxLoadFactor = 0.5;
     m_nSlots = 8;
     
-    m_hashTable = new std::list<Node>*[m_nSlots];
-    for (int i = 0; i < m_nSlots; i++)                          //initialize all of the buckets to nullptr
-        *(m_hashTable+i) = nullptr;
+    m_hashTable = newTable(m_nSlots);
     
     m_filledBuckets=0;
     m_associations=0;
     
 }
 
-template<typename KeyType, typename ValueType>
-ExpandableHashMap<KeyType, ValueType>::~ExpandableHashMap()
+template<typename KeyType, typename ValueType, typename Hasher, typename Allocator>
+ExpandableHashMap<KeyType, ValueType, Hasher, Allocator>::~ExpandableHashMap()
 {
-    for (int i=0; i<m_nSlots; i++)
+    deleteTable(m_hashTable, m_nSlots);
+}
+
+template<typename KeyType, typename ValueType, typename Hasher, typename Allocator>
+typename ExpandableHashMap<KeyType, ValueType, Hasher, Allocator>::Bucket**
+ExpandableHashMap<KeyType, ValueType, Hasher, Allocator>::newTable(int nSlots)
+{
+    TableAllocator tableAlloc(m_alloc);
+    Bucket** table = std::allocator_traits<TableAllocator>::allocate(tableAlloc, nSlots);
+    for (int i = 0; i < nSlots; i++)                            //initialize all of the buckets to nullptr
+        table[i] = nullptr;
+    return table;
+}
+
+template<typename KeyType, typename ValueType, typename Hasher, typename Allocator>
+void ExpandableHashMap<KeyType, ValueType, Hasher, Allocator>::deleteTable(Bucket** table, int nSlots)
+{
+    BucketAllocator bucketAlloc(m_alloc);
+    for (int i=0; i<nSlots; i++)
     {
-        if (m_hashTable[i] != nullptr)
-            delete m_hashTable[i];                              //delete every bucket in the hash table
+        if (table[i] != nullptr)                                //delete every bucket in the hash table
+        {
+            std::allocator_traits<BucketAllocator>::destroy(bucketAlloc, table[i]);
+            std::allocator_traits<BucketAllocator>::deallocate(bucketAlloc, table[i], 1);
+        }
     }
-    delete [] m_hashTable;                                      //then delete the array of buckets
+    TableAllocator tableAlloc(m_alloc);
+    std::allocator_traits<TableAllocator>::deallocate(tableAlloc, table, nSlots);   //then delete the array of buckets
 }
 
-template<typename KeyType, typename ValueType>
-void ExpandableHashMap<KeyType, ValueType>::reset()
+template<typename KeyType, typename ValueType, typename Hasher, typename Allocator>
+typename ExpandableHashMap<KeyType, ValueType, Hasher, Allocator>::Bucket*
+ExpandableHashMap<KeyType, ValueType, Hasher, Allocator>::newBucket()
 {
-    ~ExpandableHashMap();                                       //destroy the table
+    BucketAllocator bucketAlloc(m_alloc);
+    Bucket* bucket = std::allocator_traits<BucketAllocator>::allocate(bucketAlloc, 1);
+    std::allocator_traits<BucketAllocator>::construct(bucketAlloc, bucket, NodeAllocator(m_alloc));
+    return bucket;
+}
+
+template<typename KeyType, typename ValueType, typename Hasher, typename Allocator>
+void ExpandableHashMap<KeyType, ValueType, Hasher, Allocator>::reset()
+{
+    deleteTable(m_hashTable, m_nSlots);                         //destroy the table
     m_nSlots = 8;                                               //and create a new one with 8 slots
-    m_hashTable = new std::list<Node>*[m_nSlots];
-    for (int i = 0; i < m_nSlots; i++)                          //initialize the buckets to nullptr
-        *(m_hashTable+i) = nullptr;
+    m_hashTable = newTable(m_nSlots);
     m_filledBuckets=0;
     m_associations=0;
 }
 
-template<typename KeyType, typename ValueType>
-int ExpandableHashMap<KeyType, ValueType>::size() const
+template<typename KeyType, typename ValueType, typename Hasher, typename Allocator>
+int ExpandableHashMap<KeyType, ValueType, Hasher, Allocator>::size() const
 {
     return m_associations;
 }
 
-template<typename KeyType, typename ValueType>
-void ExpandableHashMap<KeyType, ValueType>::associate(const KeyType& key, const ValueType& value)
+template<typename KeyType, typename ValueType, typename Hasher, typename Allocator>
+void ExpandableHashMap<KeyType, ValueType, Hasher, Allocator>::associate(const KeyType& key, const ValueType& value)
 {
 
 
-    ValueType* valptr = find(key);
+    unsigned int h = m_hash(key);
+    ValueType* valptr = const_cast<ValueType*>(findHashed(key, h));
     if (valptr!=nullptr)                                        //value was found
     {
         *valptr = value;                                        //replace the value
         return;
     }
-    unsigned int hasher(const KeyType& key);
-    unsigned int index = hasher(key) % m_nSlots;
 
     //reaching this point means that we would be adding a new association
-    Node newBucket;                                             //create a new bucket
-    newBucket.k = key;                                          //with the appropriate key
-    newBucket.v = value;                                        //and value
+    Node newAssociation;                                        //create a new bucket
+    newAssociation.k = key;                                     //with the appropriate key
+    newAssociation.v = value;                                   //and value
+    newAssociation.h = h;                                       //and its hash, so it never has to be worked out again
     
     //check the load factor after insertion of the Node
     double loadFactorAfterInsertion = ((double) (size())+1)/ (double)m_nSlots;
@@ -110,45 +218,28 @@ void ExpandableHashMap<KeyType, ValueType>::associate(const KeyType& key, const
     {
         int newNSlots = m_nSlots*2;                                                 //double the size
         m_filledBuckets= 0;
-        m_associations=0;
-        
-        std::list<Node>** newhash = new std::list<Node>*[newNSlots];                //create a new hash table with the new size
         
-        for (int i=0; i<newNSlots; i++)                                             //initialize buckets to nullptr
-            newhash[i] = nullptr;
+        Bucket** newhash = newTable(newNSlots);                                     //create a new hash table with the new size
         
         for (int i=0; i<m_nSlots; i++)                                              //rehash the associations in prev hash table into new hash table
         {
             if (m_hashTable[i]==nullptr)
                 continue;
             
-            typename std::list<Node>::iterator it;
+            typename Bucket::iterator it;
             for (it= (*m_hashTable[i]).begin(); it != (*m_hashTable[i]).end(); it++)//for ever association in every bucket in the hash table
             {
-                Node newRehashbucket = *it;
-                unsigned int newIndex = hasher(newRehashbucket.k)%newNSlots;        //get the new index for the association
-                //std::cerr<<newIndex<<std::endl;
+                unsigned int newIndex = it->h & (newNSlots-1);                      //get the new index from the stored hash
                 if (newhash[newIndex]==nullptr)                                     //if the bucket at the new index is nullptr
                 {
-                    newhash[newIndex]= new std::list<Node>;                         //make a new list
-                    newhash[newIndex]->push_back(newRehashbucket);                  //push back the value into that list
+                    newhash[newIndex]= newBucket();                                 //make a new list
                     m_filledBuckets++;
-                    m_associations++;
                 }
-                else
-                {                                                                   //if there is a collision
-                    (*newhash[newIndex]).push_back(newRehashbucket);                //push back on the existing list at the bucket
-                    m_associations++;
-                }
-            }
+                newhash[newIndex]->push_back(*it);                                  //copying keeps each new bucket's nodes
+            }                                                                       //close together
         }
         
-                                                                                    //delete the old hash table
-        for (int i=0; i<m_nSlots; i++)
-        {
-            delete m_hashTable[i];
-        }
-        delete [] m_hashTable;
+        deleteTable(m_hashTable, m_nSlots);                                         //delete the old hash table
             
         
                                                                                     //reset the new hash table
@@ -157,42 +248,85 @@ void ExpandableHashMap<KeyType, ValueType>::associate(const KeyType& key, const
     }
     
     //proceed to add the new association into the hash table
-    index = hasher(key) % m_nSlots;                                                 //get an index for the new association
+    unsigned int index = h & (m_nSlots-1);                                          //get an index for the new association
     if (m_hashTable[index]==nullptr)                                                //if bucket at index is a nullptr
     {
-        m_hashTable[index]= new std::list<Node>;                                    //make a new list
-        m_hashTable[index]->push_back(newBucket);                                   //add association to the list
+        m_hashTable[index]= newBucket();                                            //make a new list
         m_filledBuckets++;
-        m_associations++;
-
     }
-    else
+    m_hashTable[index]->push_back(newAssociation);                                  //add association to the list, which may
+    m_associations++;                                                               //already hold others that collided with it
+}
+
+template<typename KeyType, typename ValueType, typename Hasher, typename Allocator>
+const ValueType* ExpandableHashMap<KeyType, ValueType, Hasher, Allocator>::find(const KeyType& key) const
+{
+    return findHashed(key, m_hash(key));
+}
+
+template<typename KeyType, typename ValueType, typename Hasher, typename Allocator>
+void ExpandableHashMap<KeyType, ValueType, Hasher, Allocator>::findMany(const KeyType* keys, int count,
+                                                                        const ValueType** results) const
+{
+    const int GROUP = 8;                                                            //lookups in flight at once
+    unsigned int hashes[GROUP];
+    for (int first=0; first<count; first+=GROUP)
     {
-                                                                                    //there is a collision with the new association
-        (*m_hashTable[index]).push_back(newBucket);                                 //then push back on the existing list
-        m_associations++;
+        int n = count - first < GROUP ? count - first : GROUP;
+        for (int i=0; i<n; i++)                                                     //the slots in the table
+        {
+            hashes[i] = m_hash(keys[first+i]);
+            prefetchForRead(&m_hashTable[hashes[i] & (m_nSlots-1)]);
+        }
+        for (int i=0; i<n; i++)
+            results[first+i] = findHashed(keys[first+i], hashes[i]);
     }
 }
 
-template<typename KeyType, typename ValueType>
-const ValueType* ExpandableHashMap<KeyType, ValueType>::find(const KeyType& key) const
+template<typename KeyType, typename ValueType, typename Hasher, typename Allocator>
+template<typename LookupKey>
+const ValueType* ExpandableHashMap<KeyType, ValueType, Hasher, Allocator>::findHashed(const LookupKey& key,
+                                                                                       unsigned int h) const
 {
-    unsigned int hasher(const KeyType& key);
-    unsigned int index = hasher(key) % m_nSlots;                                    //get the index from the hash function for the key
-    
-    std::list<Node>* concernedList = m_hashTable[index];
+    Bucket* concernedList = m_hashTable[h & (m_nSlots-1)];                          //the number of slots is a power of two
     if (concernedList==nullptr)                                                     //if there is no list at the bucket
         return nullptr;                                                             //then there is no association with the key
     
-    typename std::list<Node>::iterator it;
+    typename Bucket::iterator it;
     it = (*concernedList).begin();
+    int probes = 0;
     while (it != (*concernedList).end())                                            //go through the entire list at the bucket
     {
-        if (it->k == key)                                                           //return the pointer to the value if there is a matching key
+        probes++;
+        if (it->h == h && it->k == key)                                             //only keys with the same hash need comparing
+        {
+            STATS_COUNT(hashProbes, probes);
             return &(it->v);
+        }
         it++;
     }
+    STATS_COUNT(hashProbes, probes);
     return nullptr;                                                                 //return nullptr if there is no matching key in the list
 }
 
+template<typename KeyType, typename ValueType, typename Hasher, typename Allocator>
+HashMapProbeStats ExpandableHashMap<KeyType, ValueType, Hasher, Allocator>::probeStats() const
+{
+    //finding the k-th entry of a bucket compares k entries, so a bucket of n costs n(n+1)/2 over all its keys
+    HashMapProbeStats stats = { m_associations, m_nSlots, m_filledBuckets, 0, 0 };
+    double totalProbes = 0;
+    for (int i=0; i<m_nSlots; i++)
+    {
+        if (m_hashTable[i] == nullptr)
+            continue;
+        int n = (int)m_hashTable[i]->size();
+        if (n > stats.longestBucket)
+            stats.longestBucket = n;
+        totalProbes += n * (n + 1) / 2.0;
+    }
+    if (m_associations > 0)
+        stats.averageProbes = totalProbes / m_associations;
+    return stats;
+}
+
 #endif /* ExpandableHashMap_hpp */
@@ -0,0 +1,104 @@
+#ifndef Instrumentation_h
+#define Instrumentation_h
+
+// Low-overhead counters and timers for the planning hot paths.
+//
+// A StatsScope makes a DeliveryStats record the current sink for the calling
+// thread; STATS_COUNT and STATS_TIMER then add into that record and do nothing
+// when no scope is active. Defining GOOBEREATS_MINIMAL compiles all of it out.
+
+#include "provided.h"
+#include <cstdio>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <mach/mach.h>
+#endif
+
+  // The resident set size of this process in bytes, or 0 where it can't be found
+inline long long residentSetBytes()
+{
+#ifdef __APPLE__
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS)
+        return 0;
+    return (long long)info.resident_size;
+#else
+    std::FILE* statm = std::fopen("/proc/self/statm", "r");
+    if (statm == nullptr)
+        return 0;
+    long long size = 0, resident = 0;
+    int fields = std::fscanf(statm, "%lld %lld", &size, &resident);
+    std::fclose(statm);
+    return fields == 2 ? resident * sysconf(_SC_PAGESIZE) : 0;
+#endif
+}
+
+#ifndef GOOBEREATS_MINIMAL
+
+#include <chrono>
+
+inline DeliveryStats*& currentDeliveryStats()
+{
+    thread_local DeliveryStats* current = nullptr;
+    return current;
+}
+
+class StatsScope
+{
+public:
+    StatsScope(DeliveryStats* stats)
+     : m_previous(currentDeliveryStats())
+    {
+        currentDeliveryStats() = stats;
+    }
+    ~StatsScope()
+    {
+        currentDeliveryStats() = m_previous;                //scopes nest, so restore whatever was there before
+    }
+    StatsScope(const StatsScope&) = delete;
+    StatsScope& operator=(const StatsScope&) = delete;
+private:
+    DeliveryStats* m_previous;
+};
+
+class ScopedTimer
+{
+public:
+    ScopedTimer(double DeliveryStats::* field)
+     : m_field(field), m_start(std::chrono::steady_clock::now())
+    {}
+    ~ScopedTimer()
+    {
+        DeliveryStats* stats = currentDeliveryStats();
+        if (stats != nullptr)
+            stats->*m_field += std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+private:
+    double DeliveryStats::* m_field;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+#define STATS_CONCAT_INNER(a, b) a##b
+#define STATS_CONCAT(a, b) STATS_CONCAT_INNER(a, b)
+
+#define STATS_SCOPE(stats) StatsScope STATS_CONCAT(statsScope_, __LINE__)(stats)
+#define STATS_TIMER(field) ScopedTimer STATS_CONCAT(statsTimer_, __LINE__)(&DeliveryStats::field)
+#define STATS_COUNT(field, n)                                               \
+    do {                                                                    \
+        DeliveryStats* statsSink_ = currentDeliveryStats();                 \
+        if (statsSink_ != nullptr)                                          \
+            statsSink_->field += (n);                                       \
+    } while (false)
+
+#else
+
+#define STATS_SCOPE(stats) do {} while (false)
+#define STATS_TIMER(field) do {} while (false)
+#define STATS_COUNT(field, n) do {} while (false)
+
+#endif // GOOBEREATS_MINIMAL
+
+#endif /* Instrumentation_h */
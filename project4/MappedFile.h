@@ -0,0 +1,92 @@
+#ifndef MappedFile_h
+#define MappedFile_h
+
+// A read-only memory mapping of a whole file. Nothing is read when the file is
+// opened; the operating system pages the contents in as they are touched, and
+// adviseRandom/adviseWillNeed pass hints about how a range will be used.
+
+#include <cstddef>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+class MappedFile
+{
+public:
+    MappedFile()
+     : m_data(nullptr), m_size(0)
+    {}
+    ~MappedFile()
+    {
+        close();
+    }
+
+    bool open(const std::string& path)
+    {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        void* p = mmap(nullptr, (std::size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);                                            //the mapping keeps the file open
+        if (p == MAP_FAILED)
+            return false;
+        m_data = static_cast<const char*>(p);
+        m_size = (std::size_t)info.st_size;
+        return true;
+    }
+
+    void close()
+    {
+        if (m_data != nullptr)
+            munmap(const_cast<char*>(m_data), m_size);
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    const char* data() const { return m_data; }
+    std::size_t size() const { return m_size; }
+    bool isOpen() const { return m_data != nullptr; }
+
+    void adviseRandom(const void* p, std::size_t bytes) const     //don't read ahead around faults in this range
+    {
+        advise(p, bytes, MADV_RANDOM);
+    }
+    void adviseWillNeed(const void* p, std::size_t bytes) const   //start reading this range in the background
+    {
+        advise(p, bytes, MADV_WILLNEED);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+private:
+    const char* m_data;
+    std::size_t m_size;
+
+    void advise(const void* p, std::size_t bytes, int advice) const
+    {
+        if (m_data == nullptr || bytes == 0)
+            return;
+        //madvise wants a page aligned start, so widen the range down to the page holding p
+        std::size_t page = (std::size_t)sysconf(_SC_PAGESIZE);
+        std::size_t begin = (std::size_t)(static_cast<const char*>(p) - m_data);
+        std::size_t alignedBegin = begin - begin % page;
+        if (alignedBegin >= m_size)
+            return;
+        std::size_t length = begin + bytes - alignedBegin;
+        if (alignedBegin + length > m_size)
+            length = m_size - alignedBegin;
+        madvise(const_cast<char*>(m_data) + alignedBegin, length, advice);
+    }
+};
+
+#endif /* MappedFile_h */
@@ -1,35 +1,288 @@
 #include "provided.h"
 #include "ExpandableHashMap.h"
+#include "Arena.h"
+#include "StreetGraph.h"
+#include "CostProfiles.h"
 #include <list>
 #include <queue>
 #include <map>
 #include <algorithm>
+#include <cmath>
 using namespace std;
 
+  // All of a query's search state comes from an arena that is released in one
+  // go when the query returns. The arena belongs to the thread, so once it has
+  // grown to fit a query, later queries don't allocate at all.
+static MonotonicArena& searchArena()
+{
+    thread_local MonotonicArena arena;
+    return arena;
+}
+
+struct ReleaseArena
+{
+    ReleaseArena(MonotonicArena& arena) : m_arena(arena) {}
+    ~ReleaseArena() { m_arena.release(); }
+    MonotonicArena& m_arena;
+};
+
+  // Breadth first search for the route through the fewest segments, leaving
+  // its edges in edges; false if the end can't be reached
+static bool findFewestSegments(const StreetGraph& graph, int startNode, int endNode,
+                               MonotonicArena& arena, vector<int>& edges)
+{
+    typedef ArenaAllocator<int> IdAllocator;
+    IdAllocator idAlloc(&arena);
+    
+    ExpandableHashMap<int, int, IdHasher, IdAllocator>
+        edgeToWayPoint(0.5, idAlloc);                                           //for every visited node, the edge that got us there, which
+                                                                                //lets us backtrack the route from the end position to the start
+    queue<int, deque<int, IdAllocator>>
+        nodesToVisit(idAlloc);                                                  //the queue enables a breadth first search of the map which
+                                                                                //means that we will always find the shortest path
+    edgeToWayPoint.associate(startNode, -1);                                    //the start is visited without using any edge
+    nodesToVisit.push(startNode);                                               //push the starting position onto the queue
+    int currNode = -1;
+    while (!nodesToVisit.empty())                                               //run until there is no more coordinates left to visit
+    {
+        currNode = nodesToVisit.front();
+        nodesToVisit.pop();
+        STATS_COUNT(nodesExpanded, 1);
+        
+        if (currNode == endNode)                                                //found the end
+            break;
+        
+        for (int e=graph.firstEdge(currNode); e<graph.endEdge(currNode); e++)   //for each of the street segments that start here
+        {
+            if (graph.edgeClosed(e))                                            //the street is closed in this direction
+                continue;
+            int next = graph.edgeTo(e);
+            if (edgeToWayPoint.find(next)==nullptr)                             //if the end of that street segment has not already been visited
+            {
+                edgeToWayPoint.associate(next, e);                              //mark off the end of the street segment as visited
+                                                                                //from the current coordinate
+                nodesToVisit.push(next);                                        //enqueue the end of the street segment to be visited
+            }
+        }
+    }
+
+    if (currNode != endNode)                                                    //if the end coordinate could not be reached
+        return false;
+    
+    //reaching here means that there is a viable route; backtrack from the end along the edges that reached each
+    //node, which gives the route's edges in reverse
+    for (int e = *edgeToWayPoint.find(endNode); e != -1; e = *edgeToWayPoint.find(graph.edgeFrom(e)))
+        edges.push_back(e);
+    reverse(edges.begin(), edges.end());
+    return true;
+}
+
+  // The cheapest route under the given profile, leaving its edges in edges;
+  // false if the end can't be reached
+template<typename Profile>
+bool findCheapestRoute(const StreetGraph& graph, int startNode, int endNode, const Profile& profile,
+                       MonotonicArena& arena, vector<int>& edges)
+{
+    CheapestRouteSearch<Profile> search(graph, profile, arena);
+    if (!search.run(startNode, endNode))
+        return false;
+    search.route(edges);
+    return true;
+}
+
+  // Another profile's costs, less how much closer each edge gets to the
+  // start of a finished search by that profile (so none is negative). A search
+  // by these costs from some node settles others in order of the cost of the
+  // cheapest route from the start through them to that node, and never leaves
+  // the first search's tree.
+template<typename Profile>
+class TowardsStartProfile
+{
+public:
+    static const bool TURN_AWARE = false;
+    TowardsStartProfile(const Profile& base, const CheapestRouteSearch<Profile>& first)
+     : m_base(base), m_first(first)
+    {}
+    double edgeCost(const StreetGraph& graph, int edge) const
+    {
+        double reduced = m_base.edgeCost(graph, edge) + m_first.settledCost(graph.edgeTo(edge))
+                         - m_first.cost(graph.edgeFrom(edge));
+        return max(0.0, reduced);                                               //only ever below zero by rounding
+    }
+    double turnCost(const StreetGraph&, int, int) const { return 0; }
+private:
+    const Profile& m_base;
+    const CheapestRouteSearch<Profile>& m_first;
+};
+
+  // The edge the other way along the same street as edge, or -1 if it is
+  // closed
+static int reverseEdge(const StreetGraph& graph, int edge)
+{
+    int from = graph.edgeFrom(edge), to = graph.edgeTo(edge);
+    for (int e=graph.firstEdge(to); e<graph.endEdge(to); e++)
+        if (graph.edgeTo(e) == from && graph.edgeStreet(e) == graph.edgeStreet(edge) && !graph.edgeClosed(e))
+            return e;
+    return -1;
+}
+
+  // The cheapest route and up to count-1 alternatives to it by the plateau
+  // method. One search goes out from the start as far as maxStretch times the
+  // cheapest cost, and one back from the end (which, since every segment can
+  // be driven both ways at the same cost, is a search from the end) covers
+  // the nodes that a route within that cost could pass through; wherever
+  // the two trees share a run of edges (a plateau), the route along the first
+  // tree to the run, along it and then along the second tree to the end is
+  // locally as good as a route can be, and longer runs make better
+  // alternatives. Routes that go through a node twice, cost too much or share
+  // more than maxShare of their length with the routes already picked are
+  // passed over.
+template<typename Profile>
+static bool findAlternatives(const StreetGraph& graph, int startNode, int endNode, const Profile& profile,
+                             int count, double maxStretch, double maxShare, MonotonicArena& arena,
+                             vector<vector<int> >& routes)
+{
+    CheapestRouteSearch<Profile> forward(graph, profile, arena);
+    if (!forward.run(startNode, endNode))
+        return false;
+    routes.push_back(vector<int>());
+    forward.route(routes.back());
+    double limit = forward.cost(endNode) * maxStretch;
+    if (count < 2 || startNode == endNode)
+        return true;
+    forward.run(startNode, -1, limit, [](int, double) {});
+    
+    //the search back from the end settles nodes by how much more than the cheapest cost the best route through
+    //them costs, so it stops at the last node that a route within the limit could go through
+    typedef ArenaAllocator<int> IdAllocator;
+    vector<int, IdAllocator> reached((IdAllocator(&arena)));
+    TowardsStartProfile<Profile> backProfile(profile, forward);
+    CheapestRouteSearch<TowardsStartProfile<Profile> > backward(graph, backProfile, arena);
+    backward.run(endNode, -1, limit - forward.cost(endNode), [&](int node, double) { reached.push_back(node); });
+    
+    //in the backward tree a node's parent is the next node towards the end; the edge to it is on a plateau when
+    //the forward tree reaches the parent from the node too
+    auto toEnd = [&](int node) { return node == endNode ? -1 : graph.edgeFrom(backward.via(node)); };
+    auto onPlateau = [&](int node) {
+        int next = toEnd(node);
+        return next != -1 && next != startNode && graph.edgeFrom(forward.via(next)) == node;
+    };
+    struct Plateau
+    {
+        double length;
+        int first;
+    };
+    vector<Plateau> plateaus;
+    for (int i=0; i<(int)reached.size(); i++)
+    {
+        int node = reached[i];
+        if (!onPlateau(node))
+            continue;
+        int before = node == startNode ? -1 : graph.edgeFrom(forward.via(node));
+        if (before != -1 && backward.settled(before) && toEnd(before) == node)
+            continue;                                                           //not the first node of its plateau
+        int last = node;
+        while (onPlateau(last))
+            last = toEnd(last);
+        Plateau p = { forward.cost(last) - forward.cost(node), node };
+        plateaus.push_back(p);
+    }
+    sort(plateaus.begin(), plateaus.end(), [](const Plateau& a, const Plateau& b) {
+        return a.length > b.length || (a.length == b.length && a.first < b.first);
+    });
+    
+    typedef ArenaAllocator<pair<const int, bool> > UsedAllocator;
+    ExpandableHashMap<int, bool, IdHasher, UsedAllocator> used(0.5, UsedAllocator(&arena));  //edges of the routes so far
+    for (int k=0; k<(int)routes[0].size(); k++)
+        used.associate(routes[0][k], true);
+    for (int i=0; i<(int)plateaus.size() && (int)routes.size() < count; i++)
+    {
+        //along the forward tree to the plateau, then the backward tree (which follows the plateau) to the end
+        vector<int> edges;
+        for (int node = plateaus[i].first; node != startNode; node = graph.edgeFrom(forward.via(node)))
+            edges.push_back(forward.via(node));
+        reverse(edges.begin(), edges.end());
+        bool usable = true;
+        for (int node = plateaus[i].first; node != endNode && usable; node = toEnd(node))
+        {
+            int back = reverseEdge(graph, backward.via(node));
+            usable = back != -1;
+            edges.push_back(back);
+        }
+        
+        vector<int> nodes(1, startNode);
+        double cost = 0, length = 0, shared = 0;
+        for (int k=0; k<(int)edges.size() && usable; k++)
+        {
+            nodes.push_back(graph.edgeTo(edges[k]));
+            cost += profile.edgeCost(graph, edges[k]);
+            length += graph.edgeLength(edges[k]);
+            if (used.find(edges[k]) != nullptr)
+                shared += graph.edgeLength(edges[k]);
+        }
+        sort(nodes.begin(), nodes.end());
+        if (!usable || cost > limit || shared > maxShare * length ||
+            adjacent_find(nodes.begin(), nodes.end()) != nodes.end())
+            continue;
+        for (int k=0; k<(int)edges.size(); k++)
+            used.associate(edges[k], true);
+        routes.push_back(edges);
+    }
+    return true;
+}
+
 class PointToPointRouterImpl
 {
 public:
-    PointToPointRouterImpl(const StreetMap* sm);
+    PointToPointRouterImpl(const StreetMap* sm, RouteCost cost);
     ~PointToPointRouterImpl();
     DeliveryResult generatePointToPointRoute(
         const GeoCoord& start,
         const GeoCoord& end,
         list<StreetSegment>& route,
         double& totalDistanceTravelled) const;
+    DeliveryResult generatePointToPointRoute(
+        const MapSnapshot& map,
+        const GeoCoord& start,
+        const GeoCoord& end,
+        Route& route) const;
+    DeliveryResult findReachable(
+        const MapSnapshot& map,
+        const GeoCoord& start,
+        double maxMiles,
+        vector<ReachableLocation>& reachable) const;
+    DeliveryResult generateAlternativeRoutes(
+        const MapSnapshot& map,
+        const GeoCoord& start,
+        const GeoCoord& end,
+        int count,
+        vector<Route>& routes,
+        double maxStretch,
+        double maxShare) const;
+    MapSnapshot snapshot() const;
     
 private:
     const StreetMap* m_streetmap;
+    RouteCost m_cost;
+    static constexpr double LEFT_TURN_HOURS = 20 / 3600.0;                      //waiting for a gap in oncoming traffic
+    static constexpr double U_TURN_HOURS = 60 / 3600.0;
 };
 
-PointToPointRouterImpl::PointToPointRouterImpl(const StreetMap* sm)
+PointToPointRouterImpl::PointToPointRouterImpl(const StreetMap* sm, RouteCost cost)
 {
     m_streetmap= sm;
+    m_cost = cost;
 }
 
 PointToPointRouterImpl::~PointToPointRouterImpl()
 {
 }
 
+MapSnapshot PointToPointRouterImpl::snapshot() const
+{
+    return m_streetmap->snapshot();
+}
+
 DeliveryResult PointToPointRouterImpl::generatePointToPointRoute(
         const GeoCoord& start,
         const GeoCoord& end,
@@ -39,74 +292,204 @@ DeliveryResult PointToPointRouterImpl::generatePointToPointRoute(
     while (!route.empty())                                                      //empty the route list if there are any existing values
         route.pop_back();
     
+    Route compact;
+    DeliveryResult result = generatePointToPointRoute(m_streetmap->snapshot(), start, end, compact);
+    if (result != DELIVERY_SUCCESS)
+        return result;
+    for (int i=0; i<compact.size(); i++)                                        //only now turn the edges into street segments
+        route.push_back(compact.segment(i));
+    totalDistanceTravelled = compact.totalDistance();
+    return DELIVERY_SUCCESS;
+}
+
+DeliveryResult PointToPointRouterImpl::generatePointToPointRoute(
+        const MapSnapshot& map,
+        const GeoCoord& start,
+        const GeoCoord& end,
+        Route& route) const
+{
+    STATS_COUNT(legsRouted, 1);
+    route.clear();                                                              //empty the route if there are any existing values
+    route.m_graph = map;
+    
     if (start == end)                                                           //account for when the starting position is the ending position
-    {
-        totalDistanceTravelled=0;
         return DELIVERY_SUCCESS;
-    }
     
-    vector<StreetSegment> startingSegs;
-    if (m_streetmap->getSegmentsThatStartWith(end, startingSegs)==false      || //if the ending position does not exist in map
-        m_streetmap ->getSegmentsThatStartWith(start, startingSegs)==false)     //or the starting position does not exist in map
+    const StreetGraph& graph = *map;                                            //the whole search sees this one version
+    int startNode = graph.nodeId(start);
+    int endNode = graph.nodeId(end);
+    if (startNode == -1 || endNode == -1)                                       //if either position does not exist in map
         return BAD_COORD;                                                       //the coordinates are bad
+    if (graph.component(startNode) != graph.component(endNode))                 //no street joins their parts of the map, so
+        return NO_ROUTE;                                                        //there is no need to search to find that out
     
-    //note that at this point the vector startingSegs contains all of the street segments that begin with the starting point
+    MonotonicArena& arena = searchArena();
+    ReleaseArena releaseArena(arena);
     
-    ExpandableHashMap<GeoCoord, GeoCoord> locationOfPreviousWayPoint;           //a map that can help backtrack the route from the end position to the start
-        
-    queue<GeoCoord> coordsToVisit;                                              //the queue enables a breadth first search of the map which
-                                                                                //means that we will always find the shortest path
-    coordsToVisit.push(start);                                                  //push the starting position onto the queue
-    GeoCoord currCoord;
-    while (!coordsToVisit.empty())                                              //run until there is no more coordinates left to visit
+    bool found;
+    switch (m_cost)                                                             //each profile has its own copy of the search
     {
-        currCoord = coordsToVisit.front();
-        coordsToVisit.pop();
-        
-        if (currCoord == end)                                                   //found the end
+        case COST_DISTANCE:
+            found = findCheapestRoute(graph, startNode, endNode, DistanceProfile(), arena, route.m_edges);
+            break;
+        case COST_TRAVEL_TIME:
+            found = findCheapestRoute(graph, startNode, endNode, TravelTimeProfile(graph, arena), arena,
+                                      route.m_edges);
+            break;
+        case COST_TRAVEL_TIME_WITH_TURNS:
+            found = findCheapestRoute(graph, startNode, endNode,
+                                      TurnPenaltyProfile<TravelTimeProfile>(TravelTimeProfile(graph, arena),
+                                                                            LEFT_TURN_HOURS, U_TURN_HOURS),
+                                      arena, route.m_edges);
+            break;
+        default:
+            found = findFewestSegments(graph, startNode, endNode, arena, route.m_edges);
             break;
-        
-        m_streetmap->getSegmentsThatStartWith(currCoord, startingSegs);         //get the street segments that start with current coordinate
-        for (int i=0; i< startingSegs.size(); i++)                              //for each of those street segments
-        {
-            if (locationOfPreviousWayPoint.find(startingSegs[i].end)==nullptr)  //if the end of that street segment has not already been visited
-            {
-                locationOfPreviousWayPoint.associate(startingSegs[i].end, currCoord); //mark off the end of the street segment as visited
-                                                                                      //from the current coordinate
-                coordsToVisit.push(startingSegs[i].end);                        //enqueue the end of the street segment to be visited
-            }
-        }
-        startingSegs.clear();                                                   //empty the vector to ensure no residual segments in the next iteration
     }
-
-    if (currCoord != end)                                                       //if the end coordinate could not be reached
+    if (!found)                                                                 //if the end coordinate could not be reached
         return NO_ROUTE;                                                        //there is no route between starting and ending coordinates
     
-    //reaching here means that there is a viable route between the starting and ending coordinates
-    //important to note that reaching here also means that currCoord is the end coord
+    double totalDistanceTravelled=0;
+    for (int i=0; i<(int)route.m_edges.size(); i++)
+    {
+        totalDistanceTravelled += graph.edgeLength(route.m_edges[i]);           //increase the total distance travelled for that segment
+        route.m_distances.push_back(totalDistanceTravelled);
+    }
     
-    //starting back tracking
-    GeoCoord prev = * locationOfPreviousWayPoint.find(end);                     //prev variable denotes the GeoCoord from which we came to a
-                                                                                //certain coordiante. We start from the end coordinate.
-    totalDistanceTravelled=0;
+    return DELIVERY_SUCCESS;  
+}
+
+DeliveryResult PointToPointRouterImpl::generateAlternativeRoutes(
+        const MapSnapshot& map,
+        const GeoCoord& start,
+        const GeoCoord& end,
+        int count,
+        vector<Route>& routes,
+        double maxStretch,
+        double maxShare) const
+{
+    STATS_COUNT(legsRouted, 1);
+    routes.clear();
+    if (!isfinite(maxStretch) || maxStretch < 1 || !(maxShare >= 0 && maxShare <= 1))
+        return NO_ROUTE;                                                        //no route can meet limits like these
+    if (count < 1)
+        return DELIVERY_SUCCESS;
+    const StreetGraph& graph = *map;
+    int startNode = graph.nodeId(start);
+    int endNode = graph.nodeId(end);
+    if (startNode == -1 || endNode == -1)
+        return BAD_COORD;
+    if (graph.component(startNode) != graph.component(endNode))
+        return NO_ROUTE;
+    
+    MonotonicArena& arena = searchArena();
+    ReleaseArena releaseArena(arena);
     
-    while (currCoord!=start)                                                    //backtrack until the starting point is not reached
+    //the plateaus come from two trees of cheapest routes, so turns can't have their own cost here: alternatives
+    //by travel time with turns are alternatives by travel time
+    vector<vector<int> > found;
+    switch (m_cost)
     {
-        m_streetmap->getSegmentsThatStartWith(currCoord, startingSegs);
-        int i;
-        for (i=0; i<startingSegs.size(); i++)
-            if (startingSegs[i].end == prev)                                    //find the street segment that starts at currCoord and ends at prev
-                break;
-        route.push_front(startingSegs[i]);                                      //push that street segment into the overall route
-
-        totalDistanceTravelled+=distanceEarthMiles(startingSegs[i].start, startingSegs[i].end);
-                                                                                //increase the total distance travelled for that streetsegment
-        currCoord = prev;                                                       //set currCoord to the coord that got us to it
-        if (locationOfPreviousWayPoint.find(prev) != nullptr)
-            prev = * locationOfPreviousWayPoint.find(prev);                     //backtrack with the prev coord
+        case COST_DISTANCE:
+            findAlternatives(graph, startNode, endNode, DistanceProfile(), count, maxStretch, maxShare, arena, found);
+            break;
+        case COST_TRAVEL_TIME:
+        case COST_TRAVEL_TIME_WITH_TURNS:
+            findAlternatives(graph, startNode, endNode, TravelTimeProfile(graph, arena), count, maxStretch, maxShare,
+                             arena, found);
+            break;
+        default:
+            findAlternatives(graph, startNode, endNode, HopProfile(), count, maxStretch, maxShare, arena, found);
+            break;
     }
+    if (found.empty())
+        return NO_ROUTE;
     
-    return DELIVERY_SUCCESS;  
+    routes.resize(found.size());
+    for (int r=0; r<(int)found.size(); r++)
+    {
+        routes[r].m_graph = map;
+        routes[r].m_edges.swap(found[r]);
+        double totalDistanceTravelled = 0;
+        for (int i=0; i<(int)routes[r].m_edges.size(); i++)
+        {
+            totalDistanceTravelled += graph.edgeLength(routes[r].m_edges[i]);
+            routes[r].m_distances.push_back(totalDistanceTravelled);
+        }
+    }
+    return DELIVERY_SUCCESS;
+}
+
+DeliveryResult PointToPointRouterImpl::findReachable(
+        const MapSnapshot& map,
+        const GeoCoord& start,
+        double maxMiles,
+        vector<ReachableLocation>& reachable) const
+{
+    reachable.clear();
+    const StreetGraph& graph = *map;
+    int startNode = graph.nodeId(start);
+    if (startNode == -1)
+        return BAD_COORD;
+    
+    //one search from the start that stops once the nearest unsettled node is further than maxMiles, so its work
+    //only depends on how much of the map is inside the limit
+    MonotonicArena& arena = searchArena();
+    ReleaseArena releaseArena(arena);
+    DistanceProfile profile;
+    CheapestRouteSearch<DistanceProfile> search(graph, profile, arena);
+    search.run(startNode, -1, maxMiles, [&](int node, double distance) {
+        ReachableLocation r;
+        r.location = graph.coord(node);
+        r.distance = distance;
+        reachable.push_back(r);
+    });
+    return DELIVERY_SUCCESS;
+}
+
+  // z component of the cross product of a->b and a->c, with longitude as x
+static double cross(const GeoCoord& a, const GeoCoord& b, const GeoCoord& c)
+{
+    return (b.longitude - a.longitude) * (c.latitude - a.latitude) -
+           (b.latitude - a.latitude) * (c.longitude - a.longitude);
+}
+
+void reachableBoundary(const vector<ReachableLocation>& reachable, vector<GeoCoord>& boundary)
+{
+    //Andrew's monotone chain: sort west to east, then build the lower and upper halves of the hull in turn
+    boundary.clear();
+    vector<GeoCoord> points;
+    for (int i=0; i<(int)reachable.size(); i++)
+        points.push_back(reachable[i].location);
+    sort(points.begin(), points.end(), [](const GeoCoord& a, const GeoCoord& b) {
+        return a.longitude < b.longitude || (a.longitude == b.longitude && a.latitude < b.latitude);
+    });
+    if (points.size() < 3)
+    {
+        boundary = points;
+        return;
+    }
+    vector<GeoCoord> hull(2 * points.size());
+    int k = 0;
+    for (int i=0; i<(int)points.size(); i++)                                    //lower half
+    {
+        while (k >= 2 && cross(hull[k-2], hull[k-1], points[i]) <= 0)
+            k--;
+        hull[k++] = points[i];
+    }
+    for (int i=(int)points.size()-2, lower=k+1; i>=0; i--)                      //upper half
+    {
+        while (k >= lower && cross(hull[k-2], hull[k-1], points[i]) <= 0)
+            k--;
+        hull[k++] = points[i];
+    }
+    hull.resize(k-1);                                                           //the last point is the first one again
+    boundary.swap(hull);
+}
+
+StreetSegment Route::segment(int i) const
+{
+    return m_graph->segment(m_edges[i]);
 }
 
 //******************** PointToPointRouter functions ***************************
@@ -116,7 +499,12 @@ DeliveryResult PointToPointRouterImpl::generatePointToPointRoute(
 
 PointToPointRouter::PointToPointRouter(const StreetMap* sm)
 {
-    m_impl = new PointToPointRouterImpl(sm);
+    m_impl = new PointToPointRouterImpl(sm, COST_HOPS);
+}
+
+PointToPointRouter::PointToPointRouter(const StreetMap* sm, RouteCost cost)
+{
+    m_impl = new PointToPointRouterImpl(sm, cost);
 }
 
 PointToPointRouter::~PointToPointRouter()
@@ -132,3 +520,60 @@ DeliveryResult PointToPointRouter::generatePointToPointRoute(
 {
     return m_impl->generatePointToPointRoute(start, end, route, totalDistanceTravelled);
 }
+
+DeliveryResult PointToPointRouter::generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        Route& route) const
+{
+    return m_impl->generatePointToPointRoute(m_impl->snapshot(), start, end, route);
+}
+
+DeliveryResult PointToPointRouter::generatePointToPointRoute(
+        const MapSnapshot& map,
+        const GeoCoord& start,
+        const GeoCoord& end,
+        Route& route) const
+{
+    return m_impl->generatePointToPointRoute(map, start, end, route);
+}
+
+DeliveryResult PointToPointRouter::generateAlternativeRoutes(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        int count,
+        vector<Route>& routes,
+        double maxStretch,
+        double maxShare) const
+{
+    return m_impl->generateAlternativeRoutes(m_impl->snapshot(), start, end, count, routes, maxStretch, maxShare);
+}
+
+DeliveryResult PointToPointRouter::generateAlternativeRoutes(
+        const MapSnapshot& map,
+        const GeoCoord& start,
+        const GeoCoord& end,
+        int count,
+        vector<Route>& routes,
+        double maxStretch,
+        double maxShare) const
+{
+    return m_impl->generateAlternativeRoutes(map, start, end, count, routes, maxStretch, maxShare);
+}
+
+DeliveryResult PointToPointRouter::findReachable(
+        const GeoCoord& start,
+        double maxMiles,
+        vector<ReachableLocation>& reachable) const
+{
+    return m_impl->findReachable(m_impl->snapshot(), start, maxMiles, reachable);
+}
+
+DeliveryResult PointToPointRouter::findReachable(
+        const MapSnapshot& map,
+        const GeoCoord& start,
+        double maxMiles,
+        vector<ReachableLocation>& reachable) const
+{
+    return m_impl->findReachable(map, start, maxMiles, reachable);
+}
@@ -0,0 +1,262 @@
+#ifndef StreetGraph_h
+#define StreetGraph_h
+
+// The street network behind a StreetMap, with every intersection and every
+// directed street segment numbered. Nodes keep their coordinate text so that
+// GeoCoords can be rebuilt exactly, and each node's outgoing edges are stored
+// next to each other (in the order the segments appeared in the map file), so
+// searches can walk the graph by id without building StreetSegments.
+//
+// A finished graph can be saved in a binary layout and later mapped straight
+// from that file: nothing is parsed, and the operating system pages in node,
+// edge and text sections only as queries touch them. Looking up a coordinate
+// goes through an open addressing index that is saved along with the rest.
+//
+// Finishing a graph also labels its connected components (ignoring the
+// direction of edges, and leaving out closed ones), so that a query between
+// nodes in different components can be answered without a search.
+//
+// A finished graph is treated as immutable once it has been handed to readers.
+// Changes are made to a clone(), which shares the original's storage until it
+// first needs to write to it, and then published as a new version.
+
+#include "provided.h"
+#include "ExpandableHashMap.h"
+#include "MappedFile.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstddef>
+#include <utility>
+#include <cstring>
+
+  // FNV-1a over a coordinate's text, which is what decides whether two
+  // GeoCoords are equal (their numbers are only as exact as whatever filled
+  // them in). The index in map files is laid out by it, so unlike std::hash
+  // it has to give the same answer in every build.
+inline unsigned int coordHash(const char* lat, std::size_t latLength, const char* lon, std::size_t lonLength)
+{
+    unsigned int h = 2166136261u;
+    for (std::size_t i=0; i<latLength; i++)
+        h = (h ^ (unsigned char)lat[i]) * 16777619u;
+    h = (h ^ (unsigned char)',') * 16777619u;
+    for (std::size_t i=0; i<lonLength; i++)
+        h = (h ^ (unsigned char)lon[i]) * 16777619u;
+    return h;
+}
+
+  // Position of the cell (x, y) along a Hilbert curve through a 65536 by 65536
+  // grid; cells that are close on the curve are close in the grid
+inline unsigned long long hilbertIndex(unsigned int x, unsigned int y)
+{
+    unsigned long long d = 0;
+    for (unsigned int s = 1u << 15; s > 0; s >>= 1)
+    {
+        unsigned int rx = (x & s) != 0;
+        unsigned int ry = (y & s) != 0;
+        d += (unsigned long long)s * s * ((3 * rx) ^ ry);
+        if (ry == 0)                                                        //turn the quadrant so the curve joins up
+        {
+            if (rx == 1)
+            {
+                x = s - 1 - x;
+                y = s - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return d;
+}
+
+  // A coordinate's text wherever it already is (a GeoCoord, a line of a
+  // file), for looking coordinates up without building a GeoCoord
+struct GeoCoordView
+{
+    GeoCoordView(const char* lat, std::size_t latLength, const char* lon, std::size_t lonLength)
+     : latitudeText(lat), latitudeLength(latLength), longitudeText(lon), longitudeLength(lonLength)
+    {}
+    GeoCoordView(const GeoCoord& gc)
+     : latitudeText(gc.latitudeText.data()), latitudeLength(gc.latitudeText.size()),
+       longitudeText(gc.longitudeText.data()), longitudeLength(gc.longitudeText.size())
+    {}
+    const char* latitudeText;
+    std::size_t latitudeLength;
+    const char* longitudeText;
+    std::size_t longitudeLength;
+};
+
+inline bool operator==(const GeoCoord& gc, const GeoCoordView& view)
+{
+    return gc.latitudeText.size() == view.latitudeLength && gc.longitudeText.size() == view.longitudeLength &&
+           std::memcmp(gc.latitudeText.data(), view.latitudeText, view.latitudeLength) == 0 &&
+           std::memcmp(gc.longitudeText.data(), view.longitudeText, view.longitudeLength) == 0;
+}
+
+  // Hashes a coordinate's text where it is, without joining it into a new
+  // string; a GeoCoord and a view of it hash the same
+struct GeoCoordHasher
+{
+    unsigned int operator()(const GeoCoordView& view) const
+    {
+        return coordHash(view.latitudeText, view.latitudeLength, view.longitudeText, view.longitudeLength);
+    }
+    unsigned int operator()(const GeoCoord& gc) const
+    {
+        return (*this)(GeoCoordView(gc));
+    }
+};
+
+static const std::size_t MAX_COORD_TEXT = 255;  //longest latitude or longitude text a GraphNode can hold
+
+struct GraphNode
+{
+    double latitude;
+    double longitude;
+    unsigned int text;              //offset of the latitude text in the text pool, followed by the longitude text
+    unsigned char latitudeLength;   //at most MAX_COORD_TEXT; loaders turn down anything longer
+    unsigned char longitudeLength;
+    unsigned int firstEdge;         //outgoing edges run from here to the next node's firstEdge
+};
+
+struct GraphEdge
+{
+    unsigned int from;
+    unsigned int to;
+    unsigned int street;            //index into the street name table
+    float angle;                    //degrees counterclockwise from east, as angleOfLine gives for the segment
+    double length;                  //in miles
+};
+
+  // The start of a saved map: this header, then the node, edge, street, index,
+  // closed edge, component and text sections, each starting on a page
+  // boundary so it can be paged in on its own. Records are stored exactly as
+  // they are in memory, so a file can only be mapped by a build with the same
+  // byte order and record layout.
+struct GraphFileHeader
+{
+    char magic[8];
+    unsigned int byteOrder;
+    unsigned int nodeSize;
+    unsigned int edgeSize;
+    unsigned int nodeCount;         //not counting the sentinel, which is stored too
+    unsigned int edgeCount;
+    unsigned int streetCount;
+    unsigned int indexSlots;
+    unsigned int closedWords;       //0 when no edge is closed
+    unsigned long long textSize;
+    unsigned long long nodeOffset;
+    unsigned long long edgeOffset;
+    unsigned long long streetOffset;
+    unsigned long long indexOffset;
+    unsigned long long textOffset;
+    unsigned long long closedOffset;
+    unsigned long long componentOffset; //a label for every node
+};
+
+class StreetGraph
+{
+public:
+    StreetGraph();
+
+    int nodeCount() const { return m_nodeCount; }
+    int edgeCount() const { return m_edgeCount; }
+    int streetCount() const { return m_streetCount; }
+    unsigned long long epoch() const { return m_epoch; }     //the StreetMap numbers the versions it publishes
+
+    int nodeId(const GeoCoord& gc) const { return nodeId(GeoCoordView(gc)); }   //-1 if no segment starts or ends at gc
+    int nodeId(const GeoCoordView& view) const;
+    void nodeIds(const std::vector<GeoCoordView>& views, std::vector<int>& ids) const;  //nodeId of every view, looked
+                                                                                        //up several at a time
+    GeoCoord coord(int node) const;
+    double latitude(int node) const { return m_nodeView[node].latitude; }
+    double longitude(int node) const { return m_nodeView[node].longitude; }
+    int firstEdge(int node) const { return m_nodeView[node].firstEdge; }
+    int endEdge(int node) const { return m_nodeView[node+1].firstEdge; }
+
+    int edgeFrom(int edge) const { return m_edgeView[edge].from; }
+    int edgeTo(int edge) const { return m_edgeView[edge].to; }
+    int edgeStreet(int edge) const { return m_edgeView[edge].street; }
+    double edgeLength(int edge) const { return m_edgeView[edge].length; }
+    double edgeAngle(int edge) const { return m_edgeView[edge].angle; }
+    bool edgeClosed(int edge) const                         //closed edges stay in the graph but can't be driven on
+    {
+        return !m_closed.empty() && (m_closed[edge >> 5] >> (edge & 31) & 1) != 0;
+    }
+    const char* streetName(int street) const { return m_textView + m_streetView[street]; }
+    StreetSegment segment(int edge) const;
+    int component(int node) const { return m_componentView[node]; }    //no route joins nodes in different components
+
+    //building: add every node, street and segment, then call finish() once; no coordinate text may be longer
+    //than MAX_COORD_TEXT
+    int addNode(const GeoCoord& gc);                        //returns the existing id if gc was already added
+    int addNewNode(const char* latitudeText, int latitudeLength,  //for loaders that have already removed duplicates
+                   const char* longitudeText, int longitudeLength, double latitude, double longitude);
+    int addStreet(const std::string& name);                 //likewise for street names
+    void addSegment(int start, int end, int street);        //adds the edges in both directions
+    void finish(int threads = 1);
+
+    //changing a finished graph: edge ids stay valid until the next finish(), which drops removed edges and
+    //renumbers the rest; closing and opening take effect at once and don't need a finish()
+    std::shared_ptr<StreetGraph> clone() const;             //a new version sharing this one's storage until either changes
+    void setEpoch(unsigned long long epoch) { m_epoch = epoch; }
+    void removeEdge(int edge);
+    void setEdgeClosed(int edge, bool closed);
+    void reorder(NodeOrder order);                          //renumbers the nodes, and with them the edges, of a finished graph
+
+    //the binary layout
+    static bool isBinaryFile(const std::string& path);
+    bool save(const std::string& path) const;
+    bool map(const std::string& path);                      //replaces whatever the graph held
+    bool isMapped() const { return m_file != nullptr; }
+    void prefetchAround(int node, int radius = 2048) const; //asks for the nodes numbered near node, and their edges, to be paged in
+
+    StreetGraph(const StreetGraph&) = delete;
+    StreetGraph& operator=(const StreetGraph&) = delete;
+
+private:
+    struct Storage
+    {
+        std::vector<GraphNode> nodes;                       //one extra node at the end marks where the last node's edges stop
+        std::vector<GraphEdge> edges;                       //grouped by their starting node
+        std::vector<unsigned int> streets;                  //offset of each street's name in the text pool
+        std::string text;                                   //coordinate text and street names, each null terminated
+        std::vector<unsigned int> index;                    //node ids by coordinate hash, NO_NODE where empty
+    };
+    std::shared_ptr<Storage> m_storage;                     //shared by versions until one of them changes it
+    std::shared_ptr<const MappedFile> m_file;               //likewise, when the graph came from a saved map
+    std::vector<unsigned int> m_closed;                     //a bit per edge, or empty while no edge is closed
+    std::shared_ptr<const std::vector<unsigned int> > m_components;  //a label per node, shared by versions until closing
+                                                            //or opening an edge changes them
+    std::vector<int> m_removed;                             //edges to drop at the next finish()
+    std::vector<GraphEdge> m_pending;                       //edges added since the last finish()
+    ExpandableHashMap<GeoCoord, int, GeoCoordHasher> m_nodeIds;    //nodes added since the last finish()
+    ExpandableHashMap<std::string, int, std::hash<std::string> > m_streetIds;
+    int m_indexedNodes;                                     //nodes numbered below this are in the index
+    unsigned long long m_epoch;
+
+    //what the accessors read: either m_storage or the sections of m_file
+    const GraphNode* m_nodeView;
+    const GraphEdge* m_edgeView;
+    const unsigned int* m_streetView;
+    const char* m_textView;
+    const unsigned int* m_indexView;
+    const unsigned int* m_componentView;                    //nullptr while the labels need working out again
+    int m_nodeCount;
+    int m_edgeCount;
+    int m_streetCount;
+    std::size_t m_textSize;
+    unsigned int m_indexMask;                               //the index has a power of two number of slots
+
+    static const unsigned int NO_NODE = 0xFFFFFFFF;
+    void updateIndex();
+    void labelComponents();
+    void renumber(const std::vector<unsigned int>& newIds);
+    bool linked(int a, int b) const;
+    static bool validSections(const GraphFileHeader& h, const char* base);
+    void measureEdges(std::vector<GraphEdge>& edges, int begin, int end) const;
+    void viewOwnStorage();
+    void makeWritable();
+};
+
+#endif /* StreetGraph_h */
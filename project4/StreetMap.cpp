@@ -1,119 +1,1380 @@
 #include "provided.h"
 #include "ExpandableHashMap.h"
+#include "StreetGraph.h"
 #include <string>
 #include <vector>
 #include <functional>
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <atomic>
+#include <memory>
 using namespace std;
 
-unsigned int hasher(const GeoCoord& g)
+static double angleBetween(const GraphNode& s, const GraphNode& e)               //the same as angleOfLine
 {
-    return std::hash<string>()(g.latitudeText + g.longitudeText);
+    double result = rad2deg(atan2(e.latitude - s.latitude, e.longitude - s.longitude));
+    if (result < 0)
+        result += 360;
+    return result;
 }
 
+static double milesBetween(const GraphNode& n1, const GraphNode& n2)
+{
+    GeoCoord g1, g2;                                                        //distanceEarthMiles only looks at the numbers
+    g1.latitude = n1.latitude;
+    g1.longitude = n1.longitude;
+    g2.latitude = n2.latitude;
+    g2.longitude = n2.longitude;
+    return distanceEarthMiles(g1, g2);
+}
+
+static const char GRAPH_FILE_MAGIC[8] = { 'G', 'O', 'O', 'B', 'M', 'A', 'P', '2' };
+static const unsigned int GRAPH_BYTE_ORDER = 0x01020304;
+static const unsigned long long GRAPH_SECTION_ALIGNMENT = 4096;
+
+  // Runs work(0) .. work(threads-1) at once, the last of them on the calling thread
+static void runOnThreads(int threads, const function<void(int)>& work)
+{
+    if (threads < 1)
+        return;
+    vector<thread> workers;
+    for (int t=0; t+1<threads; t++)
+        workers.push_back(thread(work, t));
+    work(threads-1);
+    for (int t=0; t<(int)workers.size(); t++)
+        workers[t].join();
+}
+
+const unsigned int StreetGraph::NO_NODE;                                    //vector::assign takes it by reference
+
+StreetGraph::StreetGraph()
+ : m_storage(make_shared<Storage>()), m_indexedNodes(0), m_epoch(0), m_componentView(nullptr)
+{
+    GraphNode sentinel = {};
+    m_storage->nodes.push_back(sentinel);
+    viewOwnStorage();
+}
+
+int StreetGraph::nodeId(const GeoCoordView& view) const
+{
+    if (m_indexView == nullptr)                                             //nothing has been finished yet
+        return -1;
+    for (unsigned int slot = GeoCoordHasher()(view) & m_indexMask; ; slot = (slot + 1) & m_indexMask)
+    {
+        unsigned int id = m_indexView[slot];
+        if (id == NO_NODE)
+            return -1;
+        STATS_COUNT(hashProbes, 1);
+        const GraphNode& n = m_nodeView[id];
+        if (n.latitudeLength == view.latitudeLength && n.longitudeLength == view.longitudeLength &&
+            memcmp(m_textView + n.text, view.latitudeText, view.latitudeLength) == 0 &&
+            memcmp(m_textView + n.text + n.latitudeLength + 1, view.longitudeText, view.longitudeLength) == 0)
+            return id;
+    }
+}
+
+void StreetGraph::nodeIds(const vector<GeoCoordView>& views, vector<int>& ids) const
+{
+    //each lookup is a chain of dependent misses (index slot, node record, node text), so take a few lookups at
+    //a time through each step together, asking for the next step's memory for all of them before using any
+    ids.resize(views.size());
+    if (m_indexView == nullptr)
+    {
+        fill(ids.begin(), ids.end(), -1);
+        return;
+    }
+    const int GROUP = 8;
+    unsigned int slots[GROUP];
+    for (int first=0; first<(int)views.size(); first+=GROUP)
+    {
+        int n = min((int)views.size() - first, GROUP);
+        for (int i=0; i<n; i++)
+        {
+            slots[i] = GeoCoordHasher()(views[first+i]) & m_indexMask;
+            prefetchForRead(&m_indexView[slots[i]]);
+        }
+        for (int i=0; i<n; i++)
+            if (m_indexView[slots[i]] != NO_NODE)
+                prefetchForRead(&m_nodeView[m_indexView[slots[i]]]);
+        for (int i=0; i<n; i++)
+            if (m_indexView[slots[i]] != NO_NODE)
+                prefetchForRead(m_textView + m_nodeView[m_indexView[slots[i]]].text);
+        for (int i=0; i<n; i++)
+            ids[first+i] = nodeId(views[first+i]);
+    }
+}
+
+GeoCoord StreetGraph::coord(int node) const
+{
+    //fill in the fields directly rather than through the constructor, which would parse the text all over again
+    const GraphNode& n = m_nodeView[node];
+    GeoCoord gc;
+    gc.latitudeText.assign(m_textView + n.text, n.latitudeLength);
+    gc.longitudeText.assign(m_textView + n.text + n.latitudeLength + 1, n.longitudeLength);
+    gc.latitude = n.latitude;
+    gc.longitude = n.longitude;
+    return gc;
+}
+
+StreetSegment StreetGraph::segment(int edge) const
+{
+    return StreetSegment(coord(m_edgeView[edge].from), coord(m_edgeView[edge].to), streetName(m_edgeView[edge].street));
+}
+
+int StreetGraph::addNode(const GeoCoord& gc)
+{
+    int finished = nodeId(gc);
+    if (finished != -1)
+        return finished;
+    const int* existing = m_nodeIds.find(gc);
+    if (existing != nullptr)
+        return *existing;
+    
+    int id = addNewNode(gc.latitudeText.data(), (int)gc.latitudeText.size(),
+                        gc.longitudeText.data(), (int)gc.longitudeText.size(), gc.latitude, gc.longitude);
+    m_nodeIds.associate(gc, id);
+    return id;
+}
+
+int StreetGraph::addNewNode(const char* latitudeText, int latitudeLength,
+                            const char* longitudeText, int longitudeLength, double latitude, double longitude)
+{
+    makeWritable();
+    GraphNode n;
+    memset(&n, 0, sizeof(n));                                               //so saved maps don't pick up stray padding bytes
+    n.latitude = latitude;
+    n.longitude = longitude;
+    n.text = (unsigned int)m_storage->text.size();
+    n.latitudeLength = (unsigned char)latitudeLength;
+    n.longitudeLength = (unsigned char)longitudeLength;
+    n.firstEdge = m_storage->nodes.back().firstEdge;                        //no edges of its own until the next finish()
+    m_storage->text.append(latitudeText, latitudeLength);
+    m_storage->text += '\0';
+    m_storage->text.append(longitudeText, longitudeLength);
+    m_storage->text += '\0';
+    
+    int id = (int)m_storage->nodes.size() - 1;
+    m_storage->nodes.insert(m_storage->nodes.end()-1, n);                   //keep the sentinel at the end
+    viewOwnStorage();
+    return id;
+}
+
+int StreetGraph::addStreet(const string& name)
+{
+    makeWritable();
+    const int* existing = m_streetIds.find(name);
+    if (existing != nullptr)
+        return *existing;
+    int id = (int)m_storage->streets.size();
+    m_storage->streets.push_back((unsigned int)m_storage->text.size());
+    m_storage->text += name;
+    m_storage->text += '\0';
+    m_streetIds.associate(name, id);
+    viewOwnStorage();
+    return id;
+}
+
+void StreetGraph::addSegment(int start, int end, int street)
+{
+    //there have to be two edges, one that starts from the starting point and one that starts from the ending
+    //point, so that a route can be mapped going along either direction on the street segment
+    GraphEdge forward = { (unsigned int)start, (unsigned int)end, (unsigned int)street, 0, 0 };
+    GraphEdge backward = { (unsigned int)end, (unsigned int)start, (unsigned int)street, 0, 0 };
+    m_pending.push_back(forward);
+    m_pending.push_back(backward);
+}
+
+void StreetGraph::finish(int threads)
+{
+    if (m_pending.empty() && m_removed.empty() && m_indexView != nullptr && m_indexedNodes == m_nodeCount)
+    {                                                                       //nothing that changes the layout
+        if (m_componentView == nullptr)                                     //but closing or opening edges may have
+            labelComponents();                                              //split or joined components
+        return;
+    }
+    makeWritable();
+    vector<GraphNode>& nodes = m_storage->nodes;
+    vector<GraphEdge>& edges = m_storage->edges;
+    
+    //the trigonometry is what takes the time here, and every new edge can be done on its own
+    if (threads < 1)
+        threads = 1;
+    int perThread = ((int)m_pending.size() + threads - 1) / threads;
+    runOnThreads(threads, [&](int t)
+    {
+        measureEdges(m_pending, min(t * perThread, (int)m_pending.size()), min((t+1) * perThread, (int)m_pending.size()));
+    });
+    
+    //group all the edges by their starting node with a counting sort; it is stable, so every node's edges stay in
+    //the order they were added; removed edges are left out, and closed ones stay closed
+    vector<char> dropped(edges.size(), false);
+    for (int i=0; i<(int)m_removed.size(); i++)
+        dropped[m_removed[i]] = true;
+    vector<GraphEdge> all;
+    vector<char> closed;
+    for (int i=0; i<(int)edges.size(); i++)
+    {
+        if (dropped[i])
+            continue;
+        all.push_back(edges[i]);
+        closed.push_back(edgeClosed(i));
+    }
+    all.insert(all.end(), m_pending.begin(), m_pending.end());
+    closed.resize(all.size(), false);
+    m_pending.clear();
+    m_removed.clear();
+    
+    vector<unsigned int> counts(nodes.size(), 0);
+    for (int i=0; i<(int)all.size(); i++)
+        counts[all[i].from+1]++;
+    for (int i=0; i+1<(int)nodes.size(); i++)
+    {
+        nodes[i].firstEdge = counts[i];
+        counts[i+1] += counts[i];
+    }
+    nodes.back().firstEdge = (unsigned int)all.size();
+    
+    edges.resize(all.size());
+    m_closed.clear();
+    for (int i=0; i<(int)all.size(); i++)
+    {
+        int e = counts[all[i].from]++;
+        edges[e] = all[i];
+        if (closed[i])
+        {
+            m_closed.resize((all.size() + 31) / 32, 0);
+            m_closed[e >> 5] |= 1u << (e & 31);
+        }
+    }
+    
+    viewOwnStorage();
+    updateIndex();
+    m_nodeIds.reset();                                                      //the index covers every node from now on
+    labelComponents();
+}
+
+void StreetGraph::measureEdges(vector<GraphEdge>& edges, int begin, int end) const
+{
+    for (int i=begin; i<end; i++)
+    {
+        GraphEdge& e = edges[i];
+        e.length = milesBetween(m_nodeView[e.from], m_nodeView[e.to]);
+        e.angle = (float)angleBetween(m_nodeView[e.from], m_nodeView[e.to]);
+    }
+}
+
+void StreetGraph::updateIndex()
+{
+    //add the nodes that aren't in the index yet, unless that would take it over half full, in which case it is
+    //rebuilt at a size that leaves room to grow
+    vector<unsigned int>& index = m_storage->index;
+    if (index.size() < 2 * (size_t)m_nodeCount || index.empty())
+    {
+        size_t slots = 16;
+        while (slots < 4 * (size_t)m_nodeCount)
+            slots *= 2;
+        index.assign(slots, NO_NODE);
+        m_indexedNodes = 0;
+    }
+    m_indexMask = (unsigned int)index.size() - 1;
+    for (int id=m_indexedNodes; id<m_nodeCount; id++)
+    {
+        const GraphNode& n = m_nodeView[id];
+        unsigned int slot = coordHash(m_textView + n.text, n.latitudeLength,
+                                      m_textView + n.text + n.latitudeLength + 1, n.longitudeLength) & m_indexMask;
+        while (index[slot] != NO_NODE)
+            slot = (slot + 1) & m_indexMask;
+        index[slot] = id;
+    }
+    m_indexedNodes = m_nodeCount;
+    m_indexView = index.data();
+}
+
+void StreetGraph::labelComponents()
+{
+    //union-find over every open edge, then number the sets in order of their lowest node, so that the same graph
+    //always gets the same labels
+    vector<unsigned int> parent(m_nodeCount);
+    for (int i=0; i<m_nodeCount; i++)
+        parent[i] = i;
+    auto root = [&](unsigned int n)
+    {
+        while (parent[n] != n)
+            n = parent[n] = parent[parent[n]];                              //path halving keeps the trees shallow
+        return n;
+    };
+    for (int e=0; e<m_edgeCount; e++)
+    {
+        if (edgeClosed(e))
+            continue;
+        unsigned int a = root(edgeFrom(e)), b = root(edgeTo(e));
+        if (a != b)
+            parent[max(a, b)] = min(a, b);                                  //every root is the lowest node of its set
+    }
+    shared_ptr<vector<unsigned int> > labels = make_shared<vector<unsigned int> >(m_nodeCount);
+    unsigned int count = 0;
+    for (int i=0; i<m_nodeCount; i++)
+    {
+        unsigned int r = root(i);
+        (*labels)[i] = (r == (unsigned int)i) ? count++ : (*labels)[r];
+    }
+    m_components = labels;
+    m_componentView = labels->data();
+}
+
+bool StreetGraph::linked(int a, int b) const
+{
+    for (int e=firstEdge(a); e<endEdge(a); e++)
+        if (edgeTo(e) == b && !edgeClosed(e))
+            return true;
+    for (int e=firstEdge(b); e<endEdge(b); e++)
+        if (edgeTo(e) == a && !edgeClosed(e))
+            return true;
+    return false;
+}
+
+void StreetGraph::viewOwnStorage()
+{
+    m_nodeView = m_storage->nodes.data();
+    m_edgeView = m_storage->edges.data();
+    m_streetView = m_storage->streets.data();
+    m_textView = m_storage->text.data();
+    m_indexView = m_storage->index.empty() ? nullptr : m_storage->index.data();
+    m_nodeCount = (int)m_storage->nodes.size() - 1;
+    m_edgeCount = (int)m_storage->edges.size();
+    m_streetCount = (int)m_storage->streets.size();
+    m_textSize = m_storage->text.size();
+}
+
+void StreetGraph::makeWritable()
+{
+    //building on a mapped graph, or on storage that another version can still read, starts from a private copy
+    if (isMapped() || m_storage.use_count() > 1)
+    {
+        shared_ptr<Storage> copy = make_shared<Storage>();
+        copy->nodes.assign(m_nodeView, m_nodeView + m_nodeCount + 1);
+        copy->edges.assign(m_edgeView, m_edgeView + m_edgeCount);
+        copy->streets.assign(m_streetView, m_streetView + m_streetCount);
+        copy->text.assign(m_textView, m_textSize);
+        if (m_indexView != nullptr)
+            copy->index.assign(m_indexView, m_indexView + m_indexMask + 1);
+        if (m_componentView != nullptr && m_components == nullptr)         //the labels were in the file too
+        {
+            m_components = make_shared<const vector<unsigned int> >(m_componentView, m_componentView + m_nodeCount);
+            m_componentView = m_components->data();
+        }
+        m_storage = copy;
+        m_file.reset();
+        viewOwnStorage();
+    }
+    if (m_streetIds.size() != m_streetCount)                               //a clone or a mapped graph starts without these
+    {
+        m_streetIds.reset();
+        for (int i=0; i<m_streetCount; i++)
+            m_streetIds.associate(streetName(i), i);
+    }
+}
+
+shared_ptr<StreetGraph> StreetGraph::clone() const
+{
+    shared_ptr<StreetGraph> copy = make_shared<StreetGraph>();
+    copy->m_storage = m_storage;
+    copy->m_file = m_file;
+    copy->m_closed = m_closed;
+    copy->m_components = m_components;
+    copy->m_componentView = m_componentView;
+    copy->m_indexedNodes = m_indexedNodes;
+    copy->m_epoch = m_epoch;
+    copy->m_nodeView = m_nodeView;
+    copy->m_edgeView = m_edgeView;
+    copy->m_streetView = m_streetView;
+    copy->m_textView = m_textView;
+    copy->m_indexView = m_indexView;
+    copy->m_nodeCount = m_nodeCount;
+    copy->m_edgeCount = m_edgeCount;
+    copy->m_streetCount = m_streetCount;
+    copy->m_textSize = m_textSize;
+    copy->m_indexMask = m_indexMask;
+    return copy;
+}
+
+void StreetGraph::removeEdge(int edge)
+{
+    m_removed.push_back(edge);
+}
+
+void StreetGraph::setEdgeClosed(int edge, bool closed)
+{
+    if (m_closed.empty() && !closed)
+        return;
+    m_closed.resize((m_edgeCount + 31) / 32, 0);
+    if (closed)
+        m_closed[edge >> 5] |= 1u << (edge & 31);
+    else
+        m_closed[edge >> 5] &= ~(1u << (edge & 31));
+    
+    //the labels only go out of date when the last open edge between two nodes closes, or one opens between two
+    //components; either way they are worked out again at the next finish()
+    int from = edgeFrom(edge), to = edgeTo(edge);
+    if (m_componentView != nullptr && (closed ? !linked(from, to) : component(from) != component(to)))
+    {
+        m_components.reset();
+        m_componentView = nullptr;
+    }
+}
+
+void StreetGraph::reorder(NodeOrder order)
+{
+    vector<unsigned int> newIds(m_nodeCount);
+    if (order == ORDER_HILBERT)
+    {
+        //scale the bounding box onto the curve's grid and sort by position along the curve, ties in the old order
+        double minLat = 90, maxLat = -90, minLon = 180, maxLon = -180;
+        for (int i=0; i<m_nodeCount; i++)
+        {
+            minLat = min(minLat, latitude(i));
+            maxLat = max(maxLat, latitude(i));
+            minLon = min(minLon, longitude(i));
+            maxLon = max(maxLon, longitude(i));
+        }
+        double latScale = maxLat > minLat ? 65535 / (maxLat - minLat) : 0;
+        double lonScale = maxLon > minLon ? 65535 / (maxLon - minLon) : 0;
+        vector<pair<unsigned long long, unsigned int> > keys(m_nodeCount);
+        for (int i=0; i<m_nodeCount; i++)
+            keys[i] = make_pair(hilbertIndex((unsigned int)((longitude(i) - minLon) * lonScale),
+                                             (unsigned int)((latitude(i) - minLat) * latScale)), (unsigned int)i);
+        sort(keys.begin(), keys.end());
+        for (int i=0; i<m_nodeCount; i++)
+            newIds[keys[i].second] = i;
+    }
+    else if (order == ORDER_BFS)
+    {
+        //number nodes as a breadth first search reaches them, starting again from the lowest unnumbered node
+        //whenever a component runs out
+        const unsigned int unnumbered = 0xFFFFFFFF;
+        newIds.assign(m_nodeCount, unnumbered);
+        vector<unsigned int> queue;
+        queue.reserve(m_nodeCount);
+        for (int root=0; root<m_nodeCount; root++)
+        {
+            if (newIds[root] != unnumbered)
+                continue;
+            newIds[root] = (unsigned int)queue.size();
+            queue.push_back(root);
+            for (size_t head = queue.size() - 1; head < queue.size(); head++)
+                for (int e=firstEdge(queue[head]); e<endEdge(queue[head]); e++)
+                    if (newIds[edgeTo(e)] == unnumbered)
+                    {
+                        newIds[edgeTo(e)] = (unsigned int)queue.size();
+                        queue.push_back(edgeTo(e));
+                    }
+        }
+    }
+    else
+        return;
+    renumber(newIds);
+}
+
+void StreetGraph::renumber(const vector<unsigned int>& newIds)
+{
+    //lay the nodes out in their new order, each followed by its edges in the same order as before, so searches
+    //still try a node's edges in the order the map file gave them
+    makeWritable();
+    vector<unsigned int> oldIds(m_nodeCount);
+    for (int i=0; i<m_nodeCount; i++)
+        oldIds[newIds[i]] = i;
+    vector<GraphNode> nodes(m_nodeCount + 1);
+    vector<GraphEdge> edges;
+    edges.reserve(m_edgeCount);
+    vector<unsigned int> closed(m_closed.empty() ? 0 : m_closed.size(), 0);
+    for (int n=0; n<m_nodeCount; n++)
+    {
+        int old = oldIds[n];
+        nodes[n] = m_nodeView[old];
+        nodes[n].firstEdge = (unsigned int)edges.size();
+        for (int e=firstEdge(old); e<endEdge(old); e++)
+        {
+            if (edgeClosed(e))
+                closed[edges.size() >> 5] |= 1u << (edges.size() & 31);
+            GraphEdge edge = m_edgeView[e];
+            edge.from = n;
+            edge.to = newIds[edge.to];
+            edges.push_back(edge);
+        }
+    }
+    nodes[m_nodeCount] = m_nodeView[m_nodeCount];
+    
+    vector<unsigned int>& index = m_storage->index;                         //the slots don't move, only what they hold
+    for (size_t slot=0; slot<index.size(); slot++)
+        if (index[slot] != NO_NODE)
+            index[slot] = newIds[index[slot]];
+    m_storage->nodes.swap(nodes);
+    m_storage->edges.swap(edges);
+    m_closed.swap(closed);
+    viewOwnStorage();
+    labelComponents();
+}
+
+bool StreetGraph::isBinaryFile(const string& path)
+{
+    ifstream inf(path, ios::binary);
+    char magic[sizeof(GRAPH_FILE_MAGIC)];
+    return inf.read(magic, sizeof(magic)) && memcmp(magic, GRAPH_FILE_MAGIC, sizeof(magic)) == 0;
+}
+
+static unsigned long long alignSection(unsigned long long offset)
+{
+    return (offset + GRAPH_SECTION_ALIGNMENT - 1) / GRAPH_SECTION_ALIGNMENT * GRAPH_SECTION_ALIGNMENT;
+}
+
+static void writeSection(ofstream& outf, unsigned long long offset, const void* data, unsigned long long size)
+{
+    static const char zeros[GRAPH_SECTION_ALIGNMENT] = {};
+    outf.write(zeros, (streamsize)(offset - (unsigned long long)outf.tellp()));
+    outf.write(static_cast<const char*>(data), (streamsize)size);
+}
+
+bool StreetGraph::save(const string& path) const
+{
+    if (m_indexView == nullptr || m_componentView == nullptr || !m_pending.empty() || !m_removed.empty())
+        return false;                                                       //only a finished graph can be saved
+    GraphFileHeader h = {};
+    memcpy(h.magic, GRAPH_FILE_MAGIC, sizeof(h.magic));
+    h.byteOrder = GRAPH_BYTE_ORDER;
+    h.nodeSize = sizeof(GraphNode);
+    h.edgeSize = sizeof(GraphEdge);
+    h.nodeCount = m_nodeCount;
+    h.edgeCount = m_edgeCount;
+    h.streetCount = m_streetCount;
+    h.indexSlots = m_indexMask + 1;
+    h.closedWords = (unsigned int)m_closed.size();
+    h.textSize = m_textSize;
+    h.nodeOffset = alignSection(sizeof(h));
+    h.edgeOffset = alignSection(h.nodeOffset + (h.nodeCount + 1ULL) * sizeof(GraphNode));
+    h.streetOffset = alignSection(h.edgeOffset + (unsigned long long)h.edgeCount * sizeof(GraphEdge));
+    h.indexOffset = alignSection(h.streetOffset + (unsigned long long)h.streetCount * sizeof(unsigned int));
+    h.closedOffset = alignSection(h.indexOffset + (unsigned long long)h.indexSlots * sizeof(unsigned int));
+    h.componentOffset = alignSection(h.closedOffset + (unsigned long long)h.closedWords * sizeof(unsigned int));
+    h.textOffset = alignSection(h.componentOffset + (unsigned long long)h.nodeCount * sizeof(unsigned int));
+    
+    ofstream outf(path, ios::binary | ios::trunc);
+    if (!outf)
+        return false;
+    outf.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    writeSection(outf, h.nodeOffset, m_nodeView, (h.nodeCount + 1ULL) * sizeof(GraphNode));
+    writeSection(outf, h.edgeOffset, m_edgeView, (unsigned long long)h.edgeCount * sizeof(GraphEdge));
+    writeSection(outf, h.streetOffset, m_streetView, (unsigned long long)h.streetCount * sizeof(unsigned int));
+    writeSection(outf, h.indexOffset, m_indexView, (unsigned long long)h.indexSlots * sizeof(unsigned int));
+    writeSection(outf, h.closedOffset, m_closed.data(), (unsigned long long)h.closedWords * sizeof(unsigned int));
+    writeSection(outf, h.componentOffset, m_componentView, (unsigned long long)h.nodeCount * sizeof(unsigned int));
+    writeSection(outf, h.textOffset, m_textView, h.textSize);
+    return (bool)outf.flush();
+}
+
+  // Whether the sections a header describes hold a graph that can be used
+  // as it is: every section on a page boundary, every id and offset in range,
+  // each node's edges starting from it, every open edge within one component
+  // and room in the index for lookups to stop. This reads the whole file, but
+  // a saved map is otherwise trusted byte for byte, so a damaged one would
+  // crash the first query that reached the damage. The sections have to lie
+  // inside the file already.
+bool StreetGraph::validSections(const GraphFileHeader& h, const char* base)
+{
+    const unsigned long long offsets[] = { h.nodeOffset, h.edgeOffset, h.streetOffset, h.indexOffset,
+                                           h.closedOffset, h.componentOffset, h.textOffset };
+    for (unsigned long long offset : offsets)
+        if (offset < sizeof(GraphFileHeader) || offset % GRAPH_SECTION_ALIGNMENT != 0)
+            return false;
+    if (h.nodeCount >= (unsigned int)INT_MAX || h.edgeCount >= (unsigned int)INT_MAX ||
+        h.streetCount >= (unsigned int)INT_MAX || h.indexSlots <= h.nodeCount ||
+        (h.textSize > 0 && base[h.textOffset + h.textSize - 1] != '\0'))  //so every offset into the text ends in a null
+        return false;
+    
+    const GraphNode* nodes = reinterpret_cast<const GraphNode*>(base + h.nodeOffset);
+    const GraphEdge* edges = reinterpret_cast<const GraphEdge*>(base + h.edgeOffset);
+    const unsigned int* streets = reinterpret_cast<const unsigned int*>(base + h.streetOffset);
+    const unsigned int* index = reinterpret_cast<const unsigned int*>(base + h.indexOffset);
+    const unsigned int* components = reinterpret_cast<const unsigned int*>(base + h.componentOffset);
+    if (nodes[0].firstEdge != 0 || nodes[h.nodeCount].firstEdge != h.edgeCount)
+        return false;
+    for (unsigned int n=0; n<h.nodeCount; n++)
+    {
+        const GraphNode& node = nodes[n];
+        if (node.firstEdge > nodes[n+1].firstEdge ||
+            (unsigned long long)node.text + node.latitudeLength + node.longitudeLength + 2 > h.textSize ||
+            components[n] >= h.nodeCount)
+            return false;
+        for (unsigned int e=node.firstEdge; e<nodes[n+1].firstEdge; e++)
+        {
+            const GraphEdge& edge = edges[e];
+            bool closed = h.closedWords != 0 &&
+                          (reinterpret_cast<const unsigned int*>(base + h.closedOffset)[e >> 5] >> (e & 31) & 1) != 0;
+            if (edge.from != n || edge.to >= h.nodeCount || edge.street >= h.streetCount || !(edge.length >= 0) ||
+                (!closed && components[edge.to] != components[n]))
+                return false;
+        }
+    }
+    for (unsigned int s=0; s<h.streetCount; s++)
+        if (streets[s] >= h.textSize)
+            return false;
+    bool emptySlot = false;
+    for (unsigned int i=0; i<h.indexSlots; i++)
+    {
+        if (index[i] == NO_NODE)
+            emptySlot = true;
+        else if (index[i] >= h.nodeCount)
+            return false;
+    }
+    if (!emptySlot)
+        return false;
+    
+    //and looking up each node's coordinates has to find that node, as nodeId would
+    const char* text = base + h.textOffset;
+    unsigned int mask = h.indexSlots - 1;
+    for (unsigned int n=0; n<h.nodeCount; n++)
+    {
+        const GraphNode& node = nodes[n];
+        const char* latitude = text + node.text;
+        const char* longitude = latitude + node.latitudeLength + 1;
+        unsigned int slot = coordHash(latitude, node.latitudeLength, longitude, node.longitudeLength) & mask;
+        for (; ; slot = (slot + 1) & mask)
+        {
+            if (index[slot] == NO_NODE)
+                return false;
+            const GraphNode& other = nodes[index[slot]];
+            if (other.latitudeLength == node.latitudeLength && other.longitudeLength == node.longitudeLength &&
+                memcmp(text + other.text, latitude, node.latitudeLength) == 0 &&
+                memcmp(text + other.text + other.latitudeLength + 1, longitude, node.longitudeLength) == 0)
+                break;
+        }
+        if (index[slot] != n)
+            return false;
+    }
+    return true;
+}
+
+  // Whether count records of recordSize bytes starting at offset lie inside a
+  // file of fileSize bytes, worked out so that no sum or product can wrap
+static bool sectionFits(unsigned long long offset, unsigned long long count, unsigned long long recordSize,
+                        unsigned long long fileSize)
+{
+    return offset <= fileSize && count <= (fileSize - offset) / recordSize;
+}
+
+bool StreetGraph::map(const string& path)
+{
+    shared_ptr<MappedFile> file = make_shared<MappedFile>();
+    if (!file->open(path) || file->size() < sizeof(GraphFileHeader))
+        return false;
+    GraphFileHeader h;
+    memcpy(&h, file->data(), sizeof(h));
+    unsigned long long size = file->size();
+    if (memcmp(h.magic, GRAPH_FILE_MAGIC, sizeof(h.magic)) != 0 || h.byteOrder != GRAPH_BYTE_ORDER ||
+        h.nodeSize != sizeof(GraphNode) || h.edgeSize != sizeof(GraphEdge) ||
+        h.indexSlots == 0 || (h.indexSlots & (h.indexSlots - 1)) != 0 ||
+        (h.closedWords != 0 && h.closedWords != (h.edgeCount + 31ULL) / 32) ||
+        !sectionFits(h.nodeOffset, h.nodeCount + 1ULL, sizeof(GraphNode), size) ||
+        !sectionFits(h.edgeOffset, h.edgeCount, sizeof(GraphEdge), size) ||
+        !sectionFits(h.streetOffset, h.streetCount, sizeof(unsigned int), size) ||
+        !sectionFits(h.indexOffset, h.indexSlots, sizeof(unsigned int), size) ||
+        !sectionFits(h.closedOffset, h.closedWords, sizeof(unsigned int), size) ||
+        !sectionFits(h.componentOffset, h.nodeCount, sizeof(unsigned int), size) ||
+        !sectionFits(h.textOffset, h.textSize, 1, size) || !validSections(h, file->data()))
+        return false;
+    
+    //let go of anything held before (other versions keep their own references to it)
+    m_storage = make_shared<Storage>();
+    m_pending.clear();
+    m_removed.clear();
+    m_nodeIds.reset();
+    m_streetIds.reset();
+    
+    m_file = file;
+    const char* base = file->data();
+    m_nodeView = reinterpret_cast<const GraphNode*>(base + h.nodeOffset);
+    m_edgeView = reinterpret_cast<const GraphEdge*>(base + h.edgeOffset);
+    m_streetView = reinterpret_cast<const unsigned int*>(base + h.streetOffset);
+    m_indexView = reinterpret_cast<const unsigned int*>(base + h.indexOffset);
+    m_textView = base + h.textOffset;
+    m_nodeCount = h.nodeCount;
+    m_edgeCount = h.edgeCount;
+    m_streetCount = h.streetCount;
+    m_textSize = h.textSize;
+    m_indexMask = h.indexSlots - 1;
+    m_indexedNodes = m_nodeCount;
+    const unsigned int* closed = reinterpret_cast<const unsigned int*>(base + h.closedOffset);
+    m_closed.assign(closed, closed + h.closedWords);
+    m_components.reset();
+    m_componentView = reinterpret_cast<const unsigned int*>(base + h.componentOffset);
+    
+    //queries jump around the file, so reading ahead of every fault would mostly fetch pages nobody wants
+    file->adviseRandom(base, file->size());
+    return true;
+}
+
+void StreetGraph::prefetchAround(int node, int radius) const
+{
+    if (!isMapped() || node < 0 || node >= m_nodeCount)
+        return;
+    int low = max(node - radius, 0);
+    int high = min(node + radius + 1, m_nodeCount);
+    m_file->adviseWillNeed(m_nodeView + low, (high - low + 1) * sizeof(GraphNode));
+    int lowEdge = firstEdge(low);
+    m_file->adviseWillNeed(m_edgeView + lowEdge, (firstEdge(high) - lowEdge) * sizeof(GraphEdge));
+}
+
+  // The text format is a series of street records: a line with the street's
+  // name, a line with its number of segments, then one line per segment with
+  // the coordinates of both ends. Large files are split into runs of whole
+  // records that are parsed on separate threads. Each chunk numbers its own
+  // nodes in the order they first appear; the chunks' nodes are then matched up
+  // by hash partition, again in parallel, so that only adding the distinct nodes
+  // to the graph is left to do in file order. The graph comes out numbered
+  // exactly as if the file had been read line by line.
+
+struct ParsedNode
+{
+    const char* latitudeText;                                               //into the file's text
+    const char* longitudeText;
+    unsigned char latitudeLength;
+    unsigned char longitudeLength;
+    unsigned int hash;
+    double latitude;
+    double longitude;
+};
+
+struct ParsedSegment
+{
+    unsigned int start;                                                     //chunk node numbers
+    unsigned int end;
+    unsigned int street;                                                    //chunk street number
+};
+
+struct ParsedChunk
+{
+    const char* begin;
+    const char* end;
+    vector<string> streets;
+    vector<ParsedNode> nodes;                                               //each distinct coordinate once
+    vector<ParsedSegment> segments;
+    vector<vector<unsigned int> > partitions;                               //chunk node numbers, split up by hash
+    vector<unsigned long long> firstSeen;                                   //for each node, where its coordinate first appeared,
+                                                                            //as chunk index << 32 | chunk node number
+    vector<int> ids;                                                        //graph node ids
+};
+
+static bool sameText(const ParsedNode& a, const ParsedNode& b)
+{
+    return a.hash == b.hash && a.latitudeLength == b.latitudeLength && a.longitudeLength == b.longitudeLength &&
+           memcmp(a.latitudeText, b.latitudeText, a.latitudeLength) == 0 &&
+           memcmp(a.longitudeText, b.longitudeText, a.longitudeLength) == 0;
+}
+
+  // An open addressing set of references to parsed nodes, told apart by their
+  // coordinate text; nodeAt turns a reference back into the node.
+template<typename NodeAt>
+class ParsedNodeSet
+{
+public:
+    ParsedNodeSet(NodeAt nodeAt)
+     : m_nodeAt(nodeAt), m_slots(1024, EMPTY), m_used(0)
+    {}
+    
+    //the reference of the node already in the set with n's text, or ref after adding it
+    unsigned long long insert(const ParsedNode& n, unsigned long long ref)
+    {
+        if (2 * (m_used + 1) > m_slots.size())
+            grow();
+        size_t mask = m_slots.size() - 1;
+        for (size_t slot = n.hash & mask; ; slot = (slot + 1) & mask)
+        {
+            if (m_slots[slot] == EMPTY)
+            {
+                m_slots[slot] = ref;
+                m_used++;
+                return ref;
+            }
+            if (sameText(m_nodeAt(m_slots[slot]), n))
+                return m_slots[slot];
+        }
+    }
+    
+private:
+    static const unsigned long long EMPTY = ~0ULL;
+    NodeAt m_nodeAt;
+    vector<unsigned long long> m_slots;
+    size_t m_used;
+    
+    void grow()
+    {
+        vector<unsigned long long> old(m_slots.size() * 2, EMPTY);
+        old.swap(m_slots);
+        size_t mask = m_slots.size() - 1;
+        for (size_t i=0; i<old.size(); i++)
+        {
+            if (old[i] == EMPTY)
+                continue;
+            size_t slot = m_nodeAt(old[i]).hash & mask;
+            while (m_slots[slot] != EMPTY)
+                slot = (slot + 1) & mask;
+            m_slots[slot] = old[i];
+        }
+    }
+};
+
+template<typename NodeAt>
+const unsigned long long ParsedNodeSet<NodeAt>::EMPTY;                     //vector's constructor takes it by reference
+
+template<typename NodeAt>
+ParsedNodeSet<NodeAt> makeParsedNodeSet(NodeAt nodeAt)
+{
+    return ParsedNodeSet<NodeAt>(nodeAt);
+}
+
+static const char* lineEnd(const char* p, const char* end)
+{
+    const char* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+    return nl == nullptr ? end : nl;
+}
+
+static const char* nextLine(const char* eol, const char* end)
+{
+    return eol == end ? end : eol + 1;
+}
+
+static bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static int parseCount(const char* p, const char* eol)
+{
+    while (p < eol && isBlank(*p))
+        p++;
+    bool negative = p < eol && *p == '-';
+    if (p < eol && (*p == '-' || *p == '+'))
+        p++;
+    int count = 0;
+    for (; p < eol && *p >= '0' && *p <= '9'; p++)
+        if (count <= 200000000)                                             //past any real count, and short of overflowing
+            count = count * 10 + (*p - '0');
+    return negative ? -count : count;
+}
+
+static const char* skipRecord(const char* p, const char* end)
+{
+    p = nextLine(lineEnd(p, end), end);                                     //name
+    if (p == end)
+        return end;
+    const char* eol = lineEnd(p, end);                                      //count
+    int count = parseCount(p, eol);
+    p = nextLine(eol, end);
+    for (int i=0; i<count && p<end; i++)
+        p = nextLine(lineEnd(p, end), end);
+    return p;
+}
+
+static int partitionOf(unsigned int hash, int partitions)
+{
+    return (int)((hash >> 24) % partitions);                                //the sets index by the low bits
+}
+
+static void parseChunk(ParsedChunk& chunk, int partitions)
+{
+    auto seen = makeParsedNodeSet([&chunk](unsigned long long ref) -> const ParsedNode& { return chunk.nodes[ref]; });
+    chunk.partitions.resize(partitions);
+    auto addNode = [&](const char* lat, size_t latLength, const char* lon, size_t lonLength)
+    {
+        ParsedNode n;
+        n.latitudeText = lat;
+        n.longitudeText = lon;
+        n.latitudeLength = (unsigned char)latLength;
+        n.longitudeLength = (unsigned char)lonLength;
+        n.hash = coordHash(lat, latLength, lon, lonLength);
+        unsigned long long number = seen.insert(n, chunk.nodes.size());
+        if (number == chunk.nodes.size())                                   //first time this chunk has seen it
+        {
+            n.latitude = strtod(lat, nullptr);                              //the file's text ends in a null, so this stops in time
+            n.longitude = strtod(lon, nullptr);
+            chunk.nodes.push_back(n);
+            chunk.partitions[partitionOf(n.hash, partitions)].push_back((unsigned int)number);
+        }
+        return (unsigned int)number;
+    };
+    
+    const char* p = chunk.begin;
+    while (p < chunk.end)
+    {
+        const char* eol = lineEnd(p, chunk.end);
+        chunk.streets.push_back(string(p, eol));
+        unsigned int street = (unsigned int)chunk.streets.size() - 1;
+        p = nextLine(eol, chunk.end);
+        if (p == chunk.end)
+            break;
+        eol = lineEnd(p, chunk.end);
+        int count = parseCount(p, eol);
+        p = nextLine(eol, chunk.end);
+        for (int i=0; i<count && p<chunk.end; i++)
+        {
+            eol = lineEnd(p, chunk.end);
+            const char* tokens[4];
+            size_t lengths[4];
+            int found = 0;
+            for (const char* q = p; q < eol && found < 4; )                 //the first four words on the line
+            {
+                while (q < eol && isBlank(*q))
+                    q++;
+                const char* word = q;
+                while (q < eol && !isBlank(*q))
+                    q++;
+                if (q > word)
+                {
+                    tokens[found] = word;
+                    lengths[found++] = q - word;
+                }
+            }
+            p = nextLine(eol, chunk.end);
+            if (found < 4 || lengths[0] > MAX_COORD_TEXT || lengths[1] > MAX_COORD_TEXT ||
+                lengths[2] > MAX_COORD_TEXT || lengths[3] > MAX_COORD_TEXT)
+                continue;                                                   //a node couldn't hold coordinates that long
+            ParsedSegment s;
+            s.start = addNode(tokens[0], lengths[0], tokens[1], lengths[1]);
+            s.end = addNode(tokens[2], lengths[2], tokens[3], lengths[3]);
+            s.street = street;
+            chunk.segments.push_back(s);
+        }
+    }
+}
+
+  // One line of a map update file. The file has a change per line, with blank
+  // lines and lines starting with # ignored:
+  //
+  //     add <lat> <lon> <lat> <lon> <street name>
+  //     remove <lat> <lon> <lat> <lon>
+  //     close <lat> <lon> <lat> <lon>
+  //     open <lat> <lon> <lat> <lon>
+  //
+  // Segments other than the added ones are named by their two ends, which can
+  // be given in either order.
+struct SegmentChange
+{
+    enum Kind { ADD, REMOVE, CLOSE, OPEN };
+    Kind kind;
+    GeoCoord start;
+    GeoCoord end;
+    string streetName;                                                      //only for ADD
+};
+
+  // Deletes versions of the map that nobody holds any more on a thread of its
+  // own, so that a query that happens to let go of the last reference to a
+  // replaced map doesn't pay for tearing it down. Once stopped, it deletes
+  // them where they are let go of instead.
+class GraphReclaimer
+{
+public:
+    GraphReclaimer()
+     : m_stopped(false)
+    {}
+    
+    void retire(shared_ptr<StreetGraph> graph)
+    {
+        unique_lock<mutex> lock(m_mutex);
+        if (m_stopped)
+            return;                                                         //graph is deleted on the way out, after the unlock
+        m_retired.push_back(move(graph));
+        lock.unlock();
+        m_wakeUp.notify_one();
+    }
+    
+    void run()
+    {
+        unique_lock<mutex> lock(m_mutex);
+        for (;;)
+        {
+            m_wakeUp.wait(lock, [this] { return m_stopped || !m_retired.empty(); });
+            vector<shared_ptr<StreetGraph> > batch;
+            batch.swap(m_retired);
+            lock.unlock();
+            batch.clear();                                                  //the deleting happens here
+            lock.lock();
+            if (m_stopped && m_retired.empty())
+                return;
+        }
+    }
+    
+    void stop()
+    {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_stopped = true;
+        }
+        m_wakeUp.notify_one();
+    }
+    
+private:
+    mutex m_mutex;
+    condition_variable m_wakeUp;
+    vector<shared_ptr<StreetGraph> > m_retired;
+    bool m_stopped;
+};
+
 class StreetMapImpl
 {
 public:
     StreetMapImpl();
     ~StreetMapImpl();
-    bool load(string mapFile);
+    bool load(string mapFile, int threads);
+    void setNodeOrder(NodeOrder order);
+    bool reload(string mapFile, int threads);
+    void reloadInBackground(string mapFile, int threads);
+    bool waitForReload();
+    bool save(string mapFile) const;
     bool getSegmentsThatStartWith(const GeoCoord& gc, vector<StreetSegment>& segs) const;
+    MapSnapshot snapshot() const;
+    bool update(const vector<SegmentChange>& changes);
+    bool applyUpdates(string deltaFile);
+    void renumber(NodeOrder order);
 private:
-    ExpandableHashMap<GeoCoord, vector<StreetSegment>> m_map;               //maintain a private map that associates a coordinate to a
-                                                                            //vector of street segments that start with it
+    shared_ptr<const StreetGraph> m_current;                                //read and replaced atomically, so queries never wait on updates
+    mutex m_updateMutex;                                                    //loads and updates take turns making the next version
+    shared_ptr<GraphReclaimer> m_reclaimer;                                 //shared with the versions, which can outlive the map
+    thread m_reclaimerThread;
+    future<bool> m_reload;                                                  //the reload running in the background, if any
+    atomic<int> m_nodeOrder;                                                //a NodeOrder, read by reloads in the background
+    void publish(const shared_ptr<StreetGraph>& next);
+    shared_ptr<StreetGraph> readMap(const string& mapFile, int threads, shared_ptr<StreetGraph> graph);
+    void loadText(StreetGraph& graph, const string& text, int threads);
 };
 
 StreetMapImpl::StreetMapImpl()
+ : m_reclaimer(make_shared<GraphReclaimer>()), m_nodeOrder(ORDER_HILBERT)
 {
+    m_current = make_shared<StreetGraph>();
+    shared_ptr<GraphReclaimer> reclaimer = m_reclaimer;
+    m_reclaimerThread = thread([reclaimer] { reclaimer->run(); });
 }
 
 StreetMapImpl::~StreetMapImpl()
 {
+    if (m_reload.valid())
+        m_reload.wait();
+    m_current.reset();                                                      //retired like any other version
+    m_reclaimer->stop();
+    m_reclaimerThread.join();
 }
 
-bool StreetMapImpl::load(string mapFile)
+MapSnapshot StreetMapImpl::snapshot() const
 {
-    ifstream inf(mapFile);
+    return atomic_load(&m_current);
+}
+
+void StreetMapImpl::publish(const shared_ptr<StreetGraph>& next)
+{
+    //queries that already hold the old version keep it alive until they are done with it, and whoever lets go
+    //of it last only hands it to the reclaimer
+    next->setEpoch(snapshot()->epoch() + 1);
+    shared_ptr<GraphReclaimer> reclaimer = m_reclaimer;
+    shared_ptr<StreetGraph> owner = next;
+    shared_ptr<const StreetGraph> published(next.get(), [reclaimer, owner](const StreetGraph*) mutable
+    {
+        reclaimer->retire(move(owner));
+    });
+    atomic_store(&m_current, published);
+}
+
+shared_ptr<StreetGraph> StreetMapImpl::readMap(const string& mapFile, int threads, shared_ptr<StreetGraph> graph)
+{
+    if (StreetGraph::isBinaryFile(mapFile))                                 //a saved map is mapped rather than read
+    {
+        graph = make_shared<StreetGraph>();
+        return graph->map(mapFile) ? graph : nullptr;
+    }
+    
+    ifstream inf(mapFile, ios::binary);
     if (!inf)
     {
         cerr << "MapFile not read in SteetMap.cpp load function"<<endl;
-        return false;                                                       //if there is no file then it can't be loaded
+        return nullptr;                                                     //if there is no file then it can't be loaded
     }
+    string text;                                                            //the whole file, read in one go
+    inf.seekg(0, ios::end);
+    text.resize((size_t)inf.tellg());
+    inf.seekg(0, ios::beg);
+    inf.read(&text[0], text.size());
     
-    string line;
-    bool itsTheLineWithTheStreetName=true;
-    bool itsTheLineWithTheCount = false;
-    string name;
-    int count=0;
-    while (getline (inf , line))
+    if (threads < 1)
+        threads = 1;
+    threads = (int)min<size_t>(threads, text.size() / (1 <<20) + 1);      //a thread for every megabyte at most
+    loadText(*graph, text, threads);
+    graph->reorder((NodeOrder)m_nodeOrder.load());
+    return graph;
+}
+
+bool StreetMapImpl::load(string mapFile, int threads)
+{
+    lock_guard<mutex> lock(m_updateMutex);
+    shared_ptr<StreetGraph> next = readMap(mapFile, threads, snapshot()->clone());  //loading more than one text file adds them together
+    if (next == nullptr)
+        return false;
+    publish(next);
+    return true;
+}
+
+void StreetMapImpl::setNodeOrder(NodeOrder order)
+{
+    m_nodeOrder = order;
+}
+
+bool StreetMapImpl::reload(string mapFile, int threads)
+{
+    //the new map is built without holding anything up, and replaces the old one in a single step
+    shared_ptr<StreetGraph> next = readMap(mapFile, threads, make_shared<StreetGraph>());
+    if (next == nullptr)
+        return false;
+    lock_guard<mutex> lock(m_updateMutex);
+    publish(next);
+    return true;
+}
+
+void StreetMapImpl::reloadInBackground(string mapFile, int threads)
+{
+    waitForReload();                                                        //one at a time
+    m_reload = async(launch::async, [this, mapFile, threads] { return reload(mapFile, threads); });
+}
+
+bool StreetMapImpl::waitForReload()
+{
+    if (!m_reload.valid())
+        return true;
+    return m_reload.get();
+}
+
+void StreetMapImpl::loadText(StreetGraph& graph, const string& text, int threads)
+{
+    //split the file into about equal runs of whole street records
+    const char* begin = text.data();
+    const char* end = begin + text.size();
+    vector<ParsedChunk> chunks;
+    size_t target = text.size() / threads + 1;
+    for (const char* p = begin; p < end; )
+    {
+        ParsedChunk chunk;
+        chunk.begin = p;
+        while (p < end && (size_t)(p - chunk.begin) < target)
+            p = skipRecord(p, end);
+        chunk.end = p;
+        chunks.push_back(chunk);
+    }
+    int numChunks = (int)chunks.size();
+    runOnThreads(numChunks, [&](int c) { parseChunk(chunks[c], threads); });
+    
+    //find where every node first appears in the file; each partition looks through the chunks in order, so the
+    //first reference to a coordinate that it keeps is the earliest one
+    for (int c=0; c<numChunks; c++)
+        chunks[c].firstSeen.resize(chunks[c].nodes.size());
+    runOnThreads(threads, [&](int part)
     {
-        istringstream iss(line);                                            //get the related line
-        
-        if (itsTheLineWithTheStreetName)                                    //for the line that contains the name of the street
+        auto first = makeParsedNodeSet([&chunks](unsigned long long ref) -> const ParsedNode&
+                                       { return chunks[ref >> 32].nodes[ref & 0xFFFFFFFF]; });
+        for (int c=0; c<numChunks; c++)
         {
-            name=line;                                                      //get the current street name
-            itsTheLineWithTheCount=true;                                    //as per the given format, the next line will give the number
-                                                                            //of segments that the street contains
-            itsTheLineWithTheStreetName=false;
+            const vector<unsigned int>& numbers = chunks[c].partitions[part];
+            for (int i=0; i<(int)numbers.size(); i++)
+            {
+                unsigned long long ref = (unsigned long long)c << 32 | numbers[i];
+                chunks[c].firstSeen[numbers[i]] = first.insert(chunks[c].nodes[numbers[i]], ref);
+            }
         }
-        else if (itsTheLineWithTheCount)                                    //for the line that contains the no. of segments of a street
+    });
+    
+    //add the streets and then the distinct nodes in file order, then point the repeats at the nodes they repeat
+    bool fresh = graph.nodeCount() == 0;                                    //or the graph may already have some of them
+    vector<vector<int> > streetIds(numChunks);
+    for (int c=0; c<numChunks; c++)
+        for (int i=0; i<(int)chunks[c].streets.size(); i++)
+            streetIds[c].push_back(graph.addStreet(chunks[c].streets[i]));
+    for (int c=0; c<numChunks; c++)
+    {
+        ParsedChunk& chunk = chunks[c];
+        chunk.ids.resize(chunk.nodes.size());
+        for (unsigned int i=0; i<chunk.nodes.size(); i++)
         {
-            iss >> count;                                                   //store the count into the variable
-            itsTheLineWithTheCount=false;
+            if (chunk.firstSeen[i] != ((unsigned long long)c << 32 | i))
+                continue;
+            const ParsedNode& n = chunk.nodes[i];
+            if (fresh)
+                chunk.ids[i] = graph.addNewNode(n.latitudeText, n.latitudeLength, n.longitudeText, n.longitudeLength,
+                                                n.latitude, n.longitude);
+            else
+                chunk.ids[i] = graph.addNode(GeoCoord(string(n.latitudeText, n.latitudeLength),
+                                                      string(n.longitudeText, n.longitudeLength)));
         }
-        else
+    }
+    runOnThreads(numChunks, [&](int c)
+    {
+        ParsedChunk& chunk = chunks[c];
+        for (int i=0; i<(int)chunk.nodes.size(); i++)
         {
-            count--;
-            string Coord1, Coord2, Coord3,Coord4;
-            iss>>Coord1>>Coord2>>Coord3>> Coord4;                           //store the coordinates
-            GeoCoord newGCoordS(Coord1, Coord2);                            //get the starting GeoCoord
-            GeoCoord newGCoordE(Coord3, Coord4);                            //get the ending GeoCoord
-        
-            //there have to be two steet segments
-            //one that starts from the starting point
-            //one that starts from the ending point
-            //so that a route can be mapped going along either direction on the street segment
-            StreetSegment newStreetSegment1(newGCoordS, newGCoordE, name);
-            StreetSegment newStreetSegment2(newGCoordE, newGCoordS, name);
-            
-            vector<StreetSegment> v;                                        //make a vector that will store the street segments that
-                                                                            //start from the starting coordinate
-            if (m_map.find(newGCoordS)!=nullptr)                            //if there are already segments that start from the starting coordinate
-            {
-                v=*m_map.find(newGCoordS);                                  //get the vector that contains those street segments
-            }
-            v.push_back(newStreetSegment1);                                 //add the street segments starting from the starting coordinate
-            m_map.associate(newGCoordS, v);                                 //replace the existing vector with the new vector
-            
-            vector<StreetSegment> vrev;                                     //this vector will contain the street segments that start from
-                                                                            //the ending coordinate
-            if (m_map.find(newGCoordE)!=nullptr)                            //if there are already segments that start from the starting coordinate
-             {
-                 vrev=*m_map.find(newGCoordE);                              //get the vector that contains those street segments
-             }
-             vrev.push_back(newStreetSegment2);                             //add the street segments starting from the ending coordinate
-             m_map.associate(newGCoordE, vrev);                             //replace the existing vector with the new vector
-          
-            if (count==0)                                                   //when the there are no more segments left for that street
-            {
-                itsTheLineWithTheStreetName=true;                           //the next line will contain the next street's name
-            }
-         }
+            unsigned long long ref = chunk.firstSeen[i];
+            if (ref != ((unsigned long long)c << 32 | i))
+                chunk.ids[i] = chunks[ref >> 32].ids[ref & 0xFFFFFFFF];
+        }
+    });
+    
+    for (int c=0; c<numChunks; c++)
+    {
+        const ParsedChunk& chunk = chunks[c];
+        for (int i=0; i<(int)chunk.segments.size(); i++)
+        {
+            const ParsedSegment& s = chunk.segments[i];
+            graph.addSegment(chunk.ids[s.start], chunk.ids[s.end], streetIds[c][s.street]);
+        }
     }
-    return true;
+    graph.finish(threads);                                                  //lay out the edges by their starting node
+}
+
+bool StreetMapImpl::save(string mapFile) const
+{
+    return snapshot()->save(mapFile);
 }
 
 bool StreetMapImpl::getSegmentsThatStartWith(const GeoCoord& gc, vector<StreetSegment>& segs) const
 {
-    if (m_map.find(gc) == nullptr)                                          //if there are no street segments that start with the geocoord
+    MapSnapshot graph = snapshot();
+    int node = graph->nodeId(gc);
+    if (node == -1)                                                         //if there are no street segments that start with the geocoord
         return false;
-    vector<StreetSegment> v = *m_map.find(gc);                              //else set segs to the vector that contains the street segments
+    vector<StreetSegment> v;                                                //else set segs to the street segments that start there
+    for (int e=graph->firstEdge(node); e<graph->endEdge(node); e++)
+        if (!graph->edgeClosed(e))
+            v.push_back(graph->segment(e));
     segs = v;
+    STATS_COUNT(segmentsCopied, v.size());
+    return true;
+}
+
+static vector<int> edgesJoining(const StreetGraph& graph, const GeoCoord& a, const GeoCoord& b)
+{
+    vector<int> edges;
+    int nodeA = graph.nodeId(a);
+    int nodeB = graph.nodeId(b);
+    if (nodeA == -1 || nodeB == -1)
+        return edges;
+    for (int e=graph.firstEdge(nodeA); e<graph.endEdge(nodeA); e++)
+        if (graph.edgeTo(e) == nodeB)
+            edges.push_back(e);
+    for (int e=graph.firstEdge(nodeB); e<graph.endEdge(nodeB); e++)
+        if (graph.edgeTo(e) == nodeA)
+            edges.push_back(e);
+    return edges;
+}
+
+bool StreetMapImpl::update(const vector<SegmentChange>& changes)
+{
+    //every change goes into a clone of the current version, which only copies the storage if segments are added
+    //or removed, and the clone is published once all of them have gone in
+    lock_guard<mutex> lock(m_updateMutex);
+    shared_ptr<StreetGraph> next = snapshot()->clone();
+    bool added = false;
+    for (int i=0; i<(int)changes.size(); i++)
+    {
+        const SegmentChange& change = changes[i];
+        if (change.kind == SegmentChange::ADD)
+        {
+            next->addSegment(next->addNode(change.start), next->addNode(change.end), next->addStreet(change.streetName));
+            added = true;
+            continue;
+        }
+        if (added)                                                          //so that segments added earlier on can be found
+            next->finish();
+        added = false;
+        vector<int> edges = edgesJoining(*next, change.start, change.end);
+        if (edges.empty())                                                  //no such segment, so nothing is published
+            return false;
+        for (int k=0; k<(int)edges.size(); k++)
+        {
+            if (change.kind == SegmentChange::REMOVE)
+                next->removeEdge(edges[k]);
+            else
+                next->setEdgeClosed(edges[k], change.kind == SegmentChange::CLOSE);
+        }
+    }
+    next->finish();
+    publish(next);
     return true;
 }
 
+void StreetMapImpl::renumber(NodeOrder order)
+{
+    lock_guard<mutex> lock(m_updateMutex);
+    shared_ptr<StreetGraph> next = snapshot()->clone();
+    next->reorder(order);
+    publish(next);
+}
+
+  // Whether text is a coordinate that a node can hold
+static bool isNodeCoordinate(const string& text)
+{
+    return text.size() <= MAX_COORD_TEXT && isCoordinate(text);
+}
+
+bool StreetMapImpl::applyUpdates(string deltaFile)
+{
+    ifstream inf(deltaFile);
+    if (!inf)
+        return false;
+    vector<SegmentChange> changes;
+    string line;
+    while (getline(inf, line))
+    {
+        istringstream iss(line);
+        string kind, lat1, lon1, lat2, lon2;
+        if (!(iss >> kind) || kind[0] == '#')
+            continue;
+        SegmentChange change;
+        if (kind == "add")
+            change.kind = SegmentChange::ADD;
+        else if (kind == "remove")
+            change.kind = SegmentChange::REMOVE;
+        else if (kind == "close")
+            change.kind = SegmentChange::CLOSE;
+        else if (kind == "open")
+            change.kind = SegmentChange::OPEN;
+        else
+        {
+            cerr << "Unknown change in map update file line: " << line << endl;
+            return false;
+        }
+        if (!(iss >> lat1 >> lon1 >> lat2 >> lon2) || !isNodeCoordinate(lat1) || !isNodeCoordinate(lon1) ||
+            !isNodeCoordinate(lat2) || !isNodeCoordinate(lon2))
+        {
+            cerr << "Bad format in map update file line: " << line << endl;
+            return false;
+        }
+        change.start = GeoCoord(lat1, lon1);
+        change.end = GeoCoord(lat2, lon2);
+        if (change.kind == SegmentChange::ADD)
+        {
+            getline(iss >> ws, change.streetName);
+            if (change.streetName.empty())
+            {
+                cerr << "Missing street name in map update file line: " << line << endl;
+                return false;
+            }
+        }
+        changes.push_back(change);
+    }
+    return update(changes);
+}
+
 //******************** StreetMap functions ************************************
 
 // These functions simply delegate to StreetMapImpl's functions.
@@ -131,10 +1392,91 @@ StreetMap::~StreetMap()
 
 bool StreetMap::load(string mapFile)
 {
-    return m_impl->load(mapFile);
+    return m_impl->load(mapFile, max((int)thread::hardware_concurrency(), 1));
+}
+
+bool StreetMap::load(string mapFile, int threads)
+{
+    return m_impl->load(mapFile, threads);
+}
+
+void StreetMap::setNodeOrder(NodeOrder order)
+{
+    m_impl->setNodeOrder(order);
+}
+
+bool StreetMap::reload(string mapFile)
+{
+    return m_impl->reload(mapFile, max((int)thread::hardware_concurrency(), 1));
+}
+
+void StreetMap::reloadInBackground(string mapFile)
+{
+    m_impl->reloadInBackground(mapFile, max((int)thread::hardware_concurrency(), 1));
+}
+
+bool StreetMap::waitForReload()
+{
+    return m_impl->waitForReload();
+}
+
+bool StreetMap::save(string mapFile) const
+{
+    return m_impl->save(mapFile);
 }
 
 bool StreetMap::getSegmentsThatStartWith(const GeoCoord& gc, vector<StreetSegment>& segs) const
 {
    return m_impl->getSegmentsThatStartWith(gc, segs);
 }
+
+MapSnapshot StreetMap::snapshot() const
+{
+    return m_impl->snapshot();
+}
+
+StreetSegment StreetMap::segment(int edge) const
+{
+    return m_impl->snapshot()->segment(edge);
+}
+
+static bool changeSegment(StreetMapImpl* impl, SegmentChange::Kind kind, const GeoCoord& start, const GeoCoord& end,
+                          const string& streetName)
+{
+    SegmentChange change;
+    change.kind = kind;
+    change.start = start;
+    change.end = end;
+    change.streetName = streetName;
+    return impl->update(vector<SegmentChange>(1, change));
+}
+
+bool StreetMap::addSegment(const GeoCoord& start, const GeoCoord& end, string streetName)
+{
+    return changeSegment(m_impl, SegmentChange::ADD, start, end, streetName);
+}
+
+bool StreetMap::removeSegment(const GeoCoord& start, const GeoCoord& end)
+{
+    return changeSegment(m_impl, SegmentChange::REMOVE, start, end, "");
+}
+
+bool StreetMap::closeSegment(const GeoCoord& start, const GeoCoord& end)
+{
+    return changeSegment(m_impl, SegmentChange::CLOSE, start, end, "");
+}
+
+bool StreetMap::openSegment(const GeoCoord& start, const GeoCoord& end)
+{
+    return changeSegment(m_impl, SegmentChange::OPEN, start, end, "");
+}
+
+bool StreetMap::applyUpdates(string deltaFile)
+{
+    return m_impl->applyUpdates(deltaFile);
+}
+
+void StreetMap::renumber(NodeOrder order)
+{
+    m_impl->renumber(order);
+}
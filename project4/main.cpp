@@ -1,9 +1,11 @@
 #include "provided.h"
+#include "Instrumentation.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <string>
 #include <vector>
+#include <chrono>
 using namespace std;
 
 bool loadDeliveryRequests(string deliveriesFile, GeoCoord& depot, vector<DeliveryRequest>& v);
@@ -11,19 +13,23 @@ bool parseDelivery(string line, string& lat, string& lon, string& item);
 
 int main(int argc, char *argv[])
 {
-    if (argc != 3)
+    bool printStats = argc == 4 && string(argv[3]) == "-stats";
+    if (argc != 3 && !printStats)
     {
-        cout << "Usage: " << argv[0] << " mapdata.txt deliveries.txt" << endl;
+        cout << "Usage: " << argv[0] << " mapdata.txt deliveries.txt [-stats]" << endl;
         return 1;
     }
 
     StreetMap sm;
 
+    auto loadStart = chrono::steady_clock::now();
     if (!sm.load(argv[1]))
     {
         cout << "Unable to load map data file " << argv[1] << endl;
         return 1;
     }
+    double loadSeconds = chrono::duration<double>(chrono::steady_clock::now() - loadStart).count();
+    long long loadResidentBytes = residentSetBytes();
 
     GeoCoord depot;
     vector<DeliveryRequest> deliveries;
@@ -38,7 +44,17 @@ int main(int argc, char *argv[])
     DeliveryPlanner dp(&sm);
     vector<DeliveryCommand> dcs;
     double totalMiles;
-    DeliveryResult result = dp.generateDeliveryPlan(depot, deliveries, dcs, totalMiles);
+    PlanResult plan;
+    DeliveryResult result = dp.generateDeliveryPlan(depot, deliveries, dcs, totalMiles, plan);
+    if (printStats)
+    {
+        cerr << "Map load: " << loadSeconds << " s, " << loadResidentBytes << " bytes resident\nPlan stats: " << plan.stats() << endl;
+        vector<DeliveryCommand> warmDcs;                  //plan again to see the cost once the map is in memory
+        double warmMiles;
+        PlanResult warmPlan;
+        dp.generateDeliveryPlan(depot, deliveries, warmDcs, warmMiles, warmPlan);
+        cerr << "Warm plan stats: " << warmPlan.stats() << endl;
+    }
     if (result == BAD_COORD)
     {
         cout << "One or more depot or delivery coordinates are invalid." << endl;
@@ -50,8 +66,9 @@ int main(int argc, char *argv[])
         return 1;
     }
     cout << "Starting at the depot...\n";
-    for (const auto& dc : dcs)
-        cout << dc.description() << endl;
+    string directions;
+    writeDeliveryCommands(dcs, directions);
+    cout << directions;
     cout << "You are back at the depot and your deliveries are done!\n";
     cout.setf(ios::fixed);
     cout.precision(2);
@@ -65,7 +82,8 @@ bool loadDeliveryRequests(string deliveriesFile, GeoCoord& depot, vector<Deliver
         return false;
     string lat;
     string lon;
-    inf >> lat >> lon;
+    if (!(inf >> lat >> lon) || !isCoordinate(lat) || !isCoordinate(lon))
+        return false;
     inf.ignore(10000, '\n');
     depot = GeoCoord(lat, lon);
     string line;
@@ -87,7 +105,7 @@ bool parseDelivery(string line, string& lat, string& lon, string& item)
         return false;
     }
     istringstream iss(line.substr(0, colon));
-    if (!(iss >> lat >> lon))
+    if (!(iss >> lat >> lon) || !isCoordinate(lat) || !isCoordinate(lon))
     {
         cout << "Bad format in deliveries file line: " << line << endl;
         return false;
@@ -8,6 +8,13 @@
 #include <string>
 #include <vector>
 #include <list>
+#include <functional>
+#include <memory>
+#include <cfloat>
+#include <cerrno>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
 
 enum DeliveryResult
 {
@@ -51,6 +58,17 @@ bool operator<(const GeoCoord& lhs, const GeoCoord& rhs)
     return lhs.longitudeText < rhs.longitudeText;
 }
 
+  // Whether all of text is a number that GeoCoord can convert without
+  // throwing, for checking coordinates read from a file before making them
+inline
+bool isCoordinate(const std::string& text)
+{
+    char* end;
+    errno = 0;
+    std::strtod(text.c_str(), &end);
+    return !text.empty() && end == text.c_str() + text.size() && errno != ERANGE;
+}
+
 struct StreetSegment
 {
     StreetSegment(const GeoCoord& s, const GeoCoord& e, std::string streetName)
@@ -72,14 +90,65 @@ bool operator==(const StreetSegment& lhs, const StreetSegment& rhs)
 }
 
 class StreetMapImpl;
+class StreetGraph;
+
+  // How a text map's intersections are numbered when it is loaded. Searches
+  // visit intersections that are near each other on the map one after
+  // another, so numbering them along a Hilbert curve over latitude and
+  // longitude, or in breadth first order, keeps their records close together
+  // in memory. File order numbers them as they first appear in the file.
+enum NodeOrder
+{
+    ORDER_FILE, ORDER_HILBERT, ORDER_BFS
+};
+
+  // One version of a StreetMap's streets, kept alive for as long as anyone
+  // holds on to it
+typedef std::shared_ptr<const StreetGraph> MapSnapshot;
 
 class StreetMap
 {
 public:
     StreetMap();
     ~StreetMap();
+      // load reads either the text format or a file written by save, which
+      // it checks and then maps into memory instead of parsing
     bool load(std::string mapFile);
+      // the same, parsing a text file on up to the given number of threads
+      // (load(mapFile) uses one per core)
+    bool load(std::string mapFile, int threads);
+      // how text maps loaded from now on are numbered (ORDER_HILBERT unless
+      // changed); saved maps keep the numbering they were saved with
+    void setNodeOrder(NodeOrder order);
+      // Replaces the whole map with the one in mapFile. Queries keep running on
+      // the old map while the new one is read, switch to it as soon as it is
+      // ready, and the old map is freed once the last of them is done with it.
+      // reloadInBackground returns at once; waitForReload waits for it and
+      // returns whether it worked.
+    bool reload(std::string mapFile);
+    void reloadInBackground(std::string mapFile);
+    bool waitForReload();
+    bool save(std::string mapFile) const;
     bool getSegmentsThatStartWith(const GeoCoord& gc, std::vector<StreetSegment>& segs) const;
+      // the numbered intersections and segments behind the map, as they are
+      // now; a query that holds on to the snapshot keeps seeing that version
+      // however the map changes in the meantime
+    MapSnapshot snapshot() const;
+      // the segment with the given edge id in the current version
+    StreetSegment segment(int edge) const;
+      // Changes to a loaded map. Each call publishes a new version, and queries
+      // that are already running carry on with the one they started with.
+      // Segments are named by their two ends, in either order; closed segments
+      // stay in the map but no route uses them until they are opened again.
+      // The calls return false, changing nothing, if there is no such segment.
+    bool addSegment(const GeoCoord& start, const GeoCoord& end, std::string streetName);
+    bool removeSegment(const GeoCoord& start, const GeoCoord& end);
+    bool closeSegment(const GeoCoord& start, const GeoCoord& end);
+    bool openSegment(const GeoCoord& start, const GeoCoord& end);
+      // applies every change listed in a map update file as one new version
+    bool applyUpdates(std::string deltaFile);
+      // publishes the current map numbered in the given order
+    void renumber(NodeOrder order);
       // We prevent a StreetMap object from being copied or assigned.
     StreetMap(const StreetMap&) = delete;
     StreetMap& operator=(const StreetMap&) = delete;
@@ -87,18 +156,109 @@ private:
     StreetMapImpl* m_impl;
 };
 
+  // A route as a sequence of edge ids in a StreetMap, with the distance
+  // travelled by the end of each segment. StreetSegments are only built when
+  // segment() is called. The route keeps the version of the map it was found
+  // on, so its edge ids stay meaningful however the map changes.
+class Route
+{
+public:
+
+    int size() const { return (int)m_edges.size(); }
+    bool empty() const { return m_edges.empty(); }
+    int edge(int i) const { return m_edges[i]; }
+      // miles from the start of the route to the end of the i-th segment
+    double distanceAfter(int i) const { return m_distances[i]; }
+    double totalDistance() const { return m_distances.empty() ? 0 : m_distances.back(); }
+    StreetSegment segment(int i) const;
+    const MapSnapshot& snapshot() const { return m_graph; }
+
+    void clear()
+    {
+        m_edges.clear();
+        m_distances.clear();
+    }
+    const std::vector<int>& edges() const { return m_edges; }
+
+private:
+    friend class PointToPointRouterImpl;
+    MapSnapshot m_graph;
+    std::vector<int> m_edges;
+    std::vector<double> m_distances;
+};
+
+  // An intersection that an isochrone reaches, and the length in miles of
+  // the shortest drive there.
+struct ReachableLocation
+{
+    GeoCoord location;
+    double distance;
+};
+
+  // What the router minimizes. Hops finds the route through the fewest
+  // segments; the others find the cheapest route, in miles, in hours at
+  // speeds guessed from the kind of street, or in hours with time added for
+  // every left turn and U-turn. Distances reported are always in miles.
+enum RouteCost
+{
+    COST_HOPS, COST_DISTANCE, COST_TRAVEL_TIME, COST_TRAVEL_TIME_WITH_TURNS
+};
+
 class PointToPointRouterImpl;
 
 class PointToPointRouter
 {
 public:
     PointToPointRouter(const StreetMap* sm);
+    PointToPointRouter(const StreetMap* sm, RouteCost cost);
     ~PointToPointRouter();
     DeliveryResult generatePointToPointRoute(
         const GeoCoord& start,
         const GeoCoord& end,
         std::list<StreetSegment>& route,
         double& totalDistanceTravelled) const;
+    DeliveryResult generatePointToPointRoute(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        Route& route) const;
+      // the same, on the given version of the map rather than the current one
+    DeliveryResult generatePointToPointRoute(
+        const MapSnapshot& map,
+        const GeoCoord& start,
+        const GeoCoord& end,
+        Route& route) const;
+      // the cheapest route (by the router's cost, without turn penalties)
+      // followed by up to count-1 others, best first, each costing at most
+      // maxStretch times the cheapest and sharing at most maxShare of its
+      // length with the routes before it; fewer if no more are that good.
+      // NO_ROUTE if maxStretch isn't a finite number of at least 1 or
+      // maxShare isn't between 0 and 1
+    DeliveryResult generateAlternativeRoutes(
+        const GeoCoord& start,
+        const GeoCoord& end,
+        int count,
+        std::vector<Route>& routes,
+        double maxStretch = 1.25,
+        double maxShare = 0.6) const;
+    DeliveryResult generateAlternativeRoutes(
+        const MapSnapshot& map,
+        const GeoCoord& start,
+        const GeoCoord& end,
+        int count,
+        std::vector<Route>& routes,
+        double maxStretch = 1.25,
+        double maxShare = 0.6) const;
+      // every intersection within maxMiles of driving from start (whatever
+      // the router's cost), nearest first, starting with start itself
+    DeliveryResult findReachable(
+        const GeoCoord& start,
+        double maxMiles,
+        std::vector<ReachableLocation>& reachable) const;
+    DeliveryResult findReachable(
+        const MapSnapshot& map,
+        const GeoCoord& start,
+        double maxMiles,
+        std::vector<ReachableLocation>& reachable) const;
       // We prevent a PointToPointRouter object from being copied or assigned.
     PointToPointRouter(const PointToPointRouter&) = delete;
     PointToPointRouter& operator=(const PointToPointRouter&) = delete;
@@ -106,6 +266,10 @@ private:
     PointToPointRouterImpl* m_impl;
 };
 
+  // The convex hull of the reachable locations, counterclockwise, as the
+  // boundary of the zone they cover
+void reachableBoundary(const std::vector<ReachableLocation>& reachable, std::vector<GeoCoord>& boundary);
+
 struct DeliveryRequest
 {
     DeliveryRequest(std::string it, const GeoCoord& loc)
@@ -115,18 +279,73 @@ struct DeliveryRequest
     GeoCoord location;
 };
 
+  // Reported to OptimizerOptions::progress whenever a start finds a shorter
+  // order. Calls never overlap but may come from the optimizer's threads.
+struct OptimizerProgress
+{
+    int cluster;                      // which cluster of a batch split into clusters, otherwise 0
+    int start;                        // which of the independent starts improved
+    long long evaluations;            // orders that start has evaluated so far
+    double elapsedSeconds;            // since optimizeDeliveryOrder was called
+    double bestDistance;              // crow distance of that start's best order (through its cluster)
+};
+
+  // How DeliveryOptimizer builds the order its search starts from. The
+  // order the deliveries were given in is kept if it is shorter.
+enum TourConstruction
+{
+    CONSTRUCT_NONE,                   // start from the order the deliveries were given in
+    CONSTRUCT_NEAREST_NEIGHBOUR,      // always on to the nearest stop not yet visited
+    CONSTRUCT_GREEDY_EDGE,            // shortest links first, with no stop linked thrice and no loops
+    CONSTRUCT_SPACE_FILLING_CURVE,    // along a Hilbert curve through the stops
+    CONSTRUCT_BEST                    // all three, keeping the shortest
+};
+
+  // Controls for DeliveryOptimizer. Each of the independent starts gets its
+  // own random engine seeded from seed and its index, so a given seed always
+  // produces the same order regardless of how many threads are used. With a
+  // budget the cooling schedule is fitted to it and the best order found so
+  // far is returned once it runs out; a time limit gives up reproducibility.
+  // Batches of more than clusterSize stops are cut into clusters of nearby
+  // stops, which are ordered on their own (each with every start) and joined
+  // up, so the time taken grows in proportion to the number of stops.
+struct OptimizerOptions
+{
+    unsigned long long seed = 1;
+    int starts = 1;                   // independent searches; the best tour wins
+    int threads = 1;                  // threads to spread the starts over
+    double timeLimitSeconds = 0;      // wall-clock budget for the whole call, 0 for none
+    long long maxEvaluations = 0;     // orders to evaluate, split between the starts, 0 for none
+    int clusterSize = 100;            // most stops to order at once, 0 for no limit
+    TourConstruction construction = CONSTRUCT_BEST;
+    int exactStops = 12;              // batches and clusters with at most this many places (up to 16) are ordered exactly
+    std::function<void(const OptimizerProgress&)> progress;
+};
+
 class DeliveryOptimizerImpl;
 
 class DeliveryOptimizer
 {
 public:
     DeliveryOptimizer(const StreetMap* sm);
+    DeliveryOptimizer(const StreetMap* sm, const OptimizerOptions& options);
     ~DeliveryOptimizer();
     void optimizeDeliveryOrder(
         const GeoCoord& depot,
         std::vector<DeliveryRequest>& deliveries,
         double& oldCrowDistance,
         double& newCrowDistance) const;
+      // also reports a lower bound on the crow distance of any order of the
+      // deliveries: newCrowDistance / lowerBound - 1 is how far from the
+      // shortest order the result could be, and lowerBound equals
+      // newCrowDistance when the order was found exactly; working it out
+      // takes a fraction of a second, whatever the number of deliveries
+    void optimizeDeliveryOrder(
+        const GeoCoord& depot,
+        std::vector<DeliveryRequest>& deliveries,
+        double& oldCrowDistance,
+        double& newCrowDistance,
+        double& lowerBound) const;
       // We prevent a DeliveryOptimizer object from being copied or assigned.
     DeliveryOptimizer(const DeliveryOptimizer&) = delete;
     DeliveryOptimizer& operator=(const DeliveryOptimizer&) = delete;
@@ -134,78 +353,274 @@ private:
     DeliveryOptimizerImpl* m_impl;
 };
 
+  // Directions used by delivery commands. Compass directions are in
+  // counterclockwise order starting from east, 45 degrees apart.
+enum CompassDirection
+{
+    DIR_EAST, DIR_NORTHEAST, DIR_NORTH, DIR_NORTHWEST,
+    DIR_WEST, DIR_SOUTHWEST, DIR_SOUTH, DIR_SOUTHEAST
+};
+
+enum TurnDirection
+{
+    TURN_NONE, TURN_LEFT, TURN_RIGHT
+};
+
+inline const char* directionName(CompassDirection dir)
+{
+    static const char* const names[] = {
+        "east", "northeast", "north", "northwest", "west", "southwest", "south", "southeast"
+    };
+    return names[dir];
+}
+
+inline const char* turnName(TurnDirection turn)
+{
+    static const char* const names[] = { "", "left", "right" };
+    return names[turn];
+}
+
+  // The strings that compact DeliveryCommands refer to by index. A plan's
+  // commands all share one of these, so copying a command copies no strings.
+class CommandNames
+{
+public:
+    virtual ~CommandNames() {}
+    virtual const char* streetName(int street) const = 0;
+    virtual const char* itemName(int item) const = 0;
+};
+
+  // Names for commands made through the string versions of the init functions
+class FixedCommandNames : public CommandNames
+{
+public:
+    FixedCommandNames(std::vector<std::string> names)
+     : m_names(names)
+    {}
+    const char* streetName(int street) const { return m_names[street].c_str(); }
+    const char* itemName(int item) const { return m_names[item].c_str(); }
+private:
+    std::vector<std::string> m_names;
+};
+
 class DeliveryCommand
 {
 public:
     DeliveryCommand()
-     : m_type(INVALID)
+     : m_type(INVALID), m_direction(0), m_street(-1), m_item(-1), m_distance(0)
     {}
 
       // make this DeliveryCommand a Proceed command
     void initAsProceedCommand(std::string dir, std::string streetName, double dist)
     {
-        m_type = PROCEED;
-        m_streetName = streetName;
-        m_direction = dir;
-        m_distance = dist;
+        initFromStrings(PROCEED, dir, streetName);
+        m_distance = (float)dist;
     }
 
       // make this DeliveryCommand a Turn command
     void initAsTurnCommand(std::string dir, std::string streetName)
     {
-        m_type = TURN;
-        m_streetName = streetName;
-        m_direction = dir;
+        initFromStrings(TURN, dir, streetName);
         m_distance = 0;
     }
 
       // make this DeliveryCommand a Deliver command
     void initAsDeliverCommand(std::string item)
+    {
+        m_type = DELIVER;
+        m_item = 0;
+        m_names = std::make_shared<FixedCommandNames>(std::vector<std::string>(1, item));
+    }
+
+      // the same, with the street and item given as indexes into names
+    void initAsProceedCommand(CompassDirection dir, int street, double dist,
+                              const std::shared_ptr<const CommandNames>& names)
+    {
+        m_type = PROCEED;
+        m_direction = (unsigned char)dir;
+        m_street = street;
+        m_distance = (float)dist;
+        m_names = names;
+    }
+
+    void initAsTurnCommand(TurnDirection dir, int street, const std::shared_ptr<const CommandNames>& names)
+    {
+        m_type = TURN;
+        m_direction = (unsigned char)dir;
+        m_street = street;
+        m_distance = 0;
+        m_names = names;
+    }
+
+    void initAsDeliverCommand(int item, const std::shared_ptr<const CommandNames>& names)
     {
         m_type = DELIVER;
         m_item = item;
+        m_names = names;
     }
 
     void increaseDistance(double byThisMuch)
     {
-        m_distance += byThisMuch;
+        m_distance += (float)byThisMuch;
     }
 
     std::string streetName() const
     {
-        return m_streetName;
+        return (m_type == TURN || m_type == PROCEED) ? m_names->streetName(m_street) : "";
     }
 
-    std::string description() const
+      // writes the description into buf, truncating it to fit size bytes
+      // including the terminating null, and returns its full length
+    int format(char* buf, std::size_t size) const
     {
-        std::ostringstream oss;
         switch (m_type)
         {
-          case INVALID:
-            oss << "<invalid>";
-            break;
           case TURN:
-            oss << "Turn " << m_direction << " on " << m_streetName;
-            break;
+            return std::snprintf(buf, size, "Turn %s on %s", directionText(), m_names->streetName(m_street));
           case PROCEED:
-            oss.setf(std::ios::fixed);
-            oss.precision(2);
-            oss << "Proceed " << m_direction << " on " << m_streetName << " for " << m_distance << " miles";
-            break;
+            return std::snprintf(buf, size, "Proceed %s on %s for %.2f miles",
+                                 directionText(), m_names->streetName(m_street), (double)m_distance);
           case DELIVER:
-            oss << "DELIVER " << m_item;
-            break;
+            return std::snprintf(buf, size, "DELIVER %s", m_names->itemName(m_item));
+          case INVALID:
+          default:
+            return std::snprintf(buf, size, "<invalid>");
         }
-        return oss.str();
+    }
+
+      // an upper bound on what format needs, without formatting anything
+    std::size_t maxLength() const
+    {
+        std::size_t textLength = 0;
+        if (m_type == TURN || m_type == PROCEED)
+            textLength = std::strlen(directionText()) + std::strlen(m_names->streetName(m_street));
+        else if (m_type == DELIVER)
+            textLength = std::strlen(m_names->itemName(m_item));
+        // "Proceed  on  for  miles" is the longest set of fixed words, and the
+        // widest %.2f of a float is a sign, FLT_MAX_10_EXP+1 digits and ".00"
+        const std::size_t FIXED_WORDS = 23;
+        const std::size_t WIDEST_DISTANCE = 1 + (FLT_MAX_10_EXP + 1) + 3;
+        return textLength + FIXED_WORDS + WIDEST_DISTANCE;
+    }
+
+    std::string description() const
+    {
+        char buf[256];
+        int length = format(buf, sizeof(buf));
+        if (length < (int)sizeof(buf))
+            return std::string(buf, length);
+        std::string result(length, '\0');
+        format(&result[0], length + 1);
+        return result;
     }
 
 private:
     enum CommandType { INVALID, PROCEED, TURN, DELIVER };
-    CommandType m_type;        // turn left, turn right, proceed
-    std::string  m_streetName;  // Westwood Blvd
-    std::string  m_direction;   // "left" for turn or "northeast" for proceed
-    std::string  m_item;        // Item to deliver
-    double       m_distance;    // 1.92 (in miles)
+    static const unsigned char TEXT_DIRECTION = 0xFF; // direction is m_names->itemName(m_item)
+    unsigned char m_type;                     // turn left, turn right, proceed
+    unsigned char m_direction;                // TurnDirection for turn or CompassDirection for proceed
+    int           m_street;                   // index of Westwood Blvd in m_names
+    int           m_item;                     // index of the item to deliver in m_names
+    float         m_distance;                 // 1.92 (in miles)
+    std::shared_ptr<const CommandNames> m_names;
+
+    const char* directionText() const
+    {
+        if (m_direction == TEXT_DIRECTION)
+            return m_names->itemName(m_item);
+        return m_type == TURN ? turnName((TurnDirection)m_direction) : directionName((CompassDirection)m_direction);
+    }
+
+    void initFromStrings(CommandType type, const std::string& dir, const std::string& streetName)
+    {
+        m_type = type;
+        m_direction = TEXT_DIRECTION;
+        for (int d = 0; d <= DIR_SOUTHEAST; d++)          // use the enum when dir is one of the usual words
+            if (type == PROCEED ? dir == directionName((CompassDirection)d)
+                                : d <= TURN_RIGHT && dir == turnName((TurnDirection)d))
+                m_direction = (unsigned char)d;
+        m_street = 0;
+        m_item = 1;
+        std::vector<std::string> names(1, streetName);
+        if (m_direction == TEXT_DIRECTION)
+            names.push_back(dir);
+        m_names = std::make_shared<FixedCommandNames>(names);
+    }
+};
+
+  // Writes the description of every command, one per line, to out with a
+  // single allocation.
+inline void writeDeliveryCommands(const std::vector<DeliveryCommand>& commands, std::string& out)
+{
+    std::size_t capacity = out.size();
+    for (std::size_t i = 0; i < commands.size(); i++)
+        capacity += commands[i].maxLength() + 1;
+    out.reserve(capacity);
+    for (std::size_t i = 0; i < commands.size(); i++)
+    {
+        std::size_t at = out.size();
+        out.resize(at + commands[i].maxLength() + 1);
+        int length = commands[i].format(&out[at], commands[i].maxLength() + 1);
+        out.resize(at + length);
+        out += '\n';
+    }
+}
+
+  // Per-plan timings (in seconds) and hot-path counters. Everything but the
+  // old and new crow distances stays zero in builds with GOOBEREATS_MINIMAL
+  // defined, which don't work out the bound either.
+struct DeliveryStats
+{
+    double totalSeconds = 0;          // whole generateDeliveryPlan call
+    double optimizeSeconds = 0;       // reordering the deliveries
+    double routeSeconds = 0;          // point-to-point routing of every leg
+    double commandSeconds = 0;        // turning routes into commands
+    long long nodesExpanded = 0;      // coordinates dequeued by the router
+    long long hashProbes = 0;         // entries compared in ExpandableHashMap lookups
+    long long segmentsCopied = 0;     // StreetSegments copied out of the StreetMap
+    long long optimizerIterations = 0;// candidate orders evaluated by the optimizer
+    long long legsRouted = 0;         // point-to-point routes generated
+    long long arenaBlocks = 0;        // blocks the routing arenas had to get from operator new
+    long long residentBytes = 0;      // resident set size of the process when the plan was done
+    double oldCrowDistance = 0;
+    double newCrowDistance = 0;
+    double crowDistanceBound = 0;     // no order of the deliveries has a shorter crow distance
+    double optimalityGap = 0;         // newCrowDistance / crowDistanceBound - 1
+};
+
+  // writes the record as a single line of JSON
+std::ostream& operator<<(std::ostream& os, const DeliveryStats& stats);
+
+  // Formats DeliveryPlanner::exportPlanGeometry can write a plan's path in.
+  // A polyline is Google's encoded polyline text (latitudes and longitudes
+  // rounded to 1e-5 degrees, each the difference from the point before,
+  // five bits to a printable character), which map libraries decode
+  // directly. The binary form is a little-endian 32-bit count of points
+  // followed by a 32-bit latitude and longitude in 1e-7 degrees for each.
+enum GeometryFormat
+{
+    GEOMETRY_POLYLINE, GEOMETRY_BINARY
+};
+
+  // What one call to generateDeliveryPlan leaves behind besides its
+  // commands: its stats and, if it made a plan, the plan's legs on the
+  // version of the map it was made on. Every call fills in its own, so plans
+  // made at the same time on one planner share nothing.
+class PlanResult
+{
+public:
+    PlanResult() : m_depotNode(-1) {}
+    const DeliveryStats& stats() const { return m_stats; }
+    bool hasPlan() const { return m_map != nullptr; }
+      // the plan's path, from the depot through every stop and back, as
+      // every intersection it passes; false if there was no plan
+    bool exportGeometry(GeometryFormat format, std::string& geometry) const;
+private:
+    friend class DeliveryPlannerImpl;
+    DeliveryStats m_stats;
+    MapSnapshot m_map;
+    int m_depotNode;
+    std::vector<Route> m_legs;
 };
 
 class DeliveryPlannerImpl;
@@ -214,12 +629,28 @@ class DeliveryPlanner
 {
 public:
     DeliveryPlanner(const StreetMap* sm);
+    DeliveryPlanner(const StreetMap* sm, const OptimizerOptions& options);
+      // routes every leg of the plan with the given cost
+    DeliveryPlanner(const StreetMap* sm, const OptimizerOptions& options, RouteCost cost);
     ~DeliveryPlanner();
     DeliveryResult generateDeliveryPlan(
         const GeoCoord& depot,
         const std::vector<DeliveryRequest>& deliveries,
         std::vector<DeliveryCommand>& commands,
         double& totalDistanceTravelled) const;
+      // the same, also filling in result with the call's stats and path
+    DeliveryResult generateDeliveryPlan(
+        const GeoCoord& depot,
+        const std::vector<DeliveryRequest>& deliveries,
+        std::vector<DeliveryCommand>& commands,
+        double& totalDistanceTravelled,
+        PlanResult& result) const;
+      // The stats and path of the call to generateDeliveryPlan on this
+      // planner that finished last (false from exportPlanGeometry if it made
+      // no plan). With calls running at the same time that is whichever
+      // finished last; pass a PlanResult to get a particular call's.
+    DeliveryStats lastPlanStats() const;
+    bool exportPlanGeometry(GeometryFormat format, std::string& geometry) const;
       // We prevent a DeliveryPlanner object from being copied or assigned.
     DeliveryPlanner(const DeliveryPlanner&) = delete;
     DeliveryPlanner& operator=(const DeliveryPlanner&) = delete;
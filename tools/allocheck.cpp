@@ -0,0 +1,145 @@
+// Counts the heap allocations PointToPointRouter makes once it is warm.
+//
+//     allocheck mapdata.txt --queries 200 --seed 1
+//
+// Global operator new is replaced with one that counts its calls. Random
+// pairs of intersections are routed with every RouteCost into a Route that
+// is reused, twice over so that the thread's search arena and the Route have
+// grown to fit them, and then once more while counting. A warm query takes
+// all of its search state from the arena and writes into the Route's
+// existing storage, so the count has to be zero; the exit status is 1 if it
+// isn't.
+
+#include "provided.h"
+#include "StreetGraph.h"
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+namespace
+{
+
+long long s_allocations = 0;
+
+void* countedAlloc(size_t size)
+{
+    s_allocations++;
+    void* p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr)
+        throw bad_alloc();
+    return p;
+}
+
+}  // namespace
+
+void* operator new(size_t size) { return countedAlloc(size); }
+void* operator new[](size_t size) { return countedAlloc(size); }
+void* operator new(size_t size, const nothrow_t&) noexcept
+{
+    s_allocations++;
+    return malloc(size == 0 ? 1 : size);
+}
+void* operator new[](size_t size, const nothrow_t& tag) noexcept { return operator new(size, tag); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, const nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, const nothrow_t&) noexcept { free(p); }
+
+namespace
+{
+
+struct Options
+{
+    string mapFile;
+    int queries = 200;
+    unsigned long long seed = 1;
+};
+
+void usage(const char* prog)
+{
+    cerr << "Usage: " << prog << " mapfile [options]\n"
+         << "  --queries N  random pairs of intersections to route (default 200)\n"
+         << "  --seed S     random seed for the pairs (default 1)\n";
+}
+
+bool parseArgs(int argc, char* argv[], Options& opts)
+{
+    if (argc < 2)
+        return false;
+    opts.mapFile = argv[1];
+    for (int i = 2; i < argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = i+1 < argc;
+        if (arg == "--queries" && hasValue)
+            opts.queries = atoi(argv[++i]);
+        else if (arg == "--seed" && hasValue)
+            opts.seed = strtoull(argv[++i], nullptr, 10);
+        else
+            return false;
+    }
+    return opts.queries > 0;
+}
+
+const RouteCost COSTS[] = { COST_HOPS, COST_DISTANCE, COST_TRAVEL_TIME, COST_TRAVEL_TIME_WITH_TURNS };
+const char* const COST_NAMES[] = { "hops", "distance", "time", "turns" };
+const int WARM_PASSES = 2;
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    Options opts;
+    if (!parseArgs(argc, argv, opts))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    StreetMap sm;
+    if (!sm.load(opts.mapFile))
+    {
+        cerr << "Unable to load map data file " << opts.mapFile << endl;
+        return 1;
+    }
+    MapSnapshot map = sm.snapshot();
+    if (map->nodeCount() == 0)
+    {
+        cerr << "Map has no intersections" << endl;
+        return 1;
+    }
+    vector<GeoCoord> starts, ends;
+    mt19937_64 rng(opts.seed);
+    for (int q = 0; q < opts.queries; q++)
+    {
+        starts.push_back(map->coord((int)(rng() % map->nodeCount())));
+        ends.push_back(map->coord((int)(rng() % map->nodeCount())));
+    }
+
+    bool failed = false;
+    for (int c = 0; c < 4; c++)
+    {
+        PointToPointRouter router(&sm, COSTS[c]);
+        Route route;
+        long long allocations = 0;
+        int routed = 0;
+        for (int pass = 0; pass <= WARM_PASSES; pass++)
+        {
+            long long before = s_allocations;
+            routed = 0;
+            for (int q = 0; q < opts.queries; q++)
+                if (router.generatePointToPointRoute(map, starts[q], ends[q], route) == DELIVERY_SUCCESS)
+                    routed++;
+            allocations = s_allocations - before;
+        }
+        cout << COST_NAMES[c] << ": " << opts.queries << " warm queries (" << routed << " routed), "
+             << allocations << " allocations" << endl;
+        failed |= allocations != 0;
+    }
+    return failed ? 1 : 0;
+}
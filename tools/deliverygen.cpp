@@ -0,0 +1,146 @@
+// Delivery file generator to go with mapgen.
+//
+// Picks a depot and N delivery locations from the intersections of a map file
+// and writes them in the format main.cpp reads:
+//
+//     <depotLat> <depotLon>
+//     <lat> <lon>:<item>                           (one line per delivery)
+//
+// Locations are drawn by reservoir sampling over the segment endpoints, so
+// the map is streamed once and never held in memory. Coordinates are copied
+// verbatim from the map so that every location is a valid GeoCoord.
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+namespace
+{
+
+const char* const ITEMS[] = {
+    "Chicken tenders", "B-Plate salmon", "Pad thai", "Burrito bowl", "Iced latte",
+    "Veggie pizza", "Boba tea", "Ramen", "Fruit cup", "Falafel wrap"
+};
+const int NUM_ITEMS = sizeof(ITEMS) / sizeof(ITEMS[0]);
+
+struct Options
+{
+    string mapFile;
+    long long deliveries = 10;
+    unsigned long long seed = 1;
+    string output;
+};
+
+void usage(const char* prog)
+{
+    cerr << "Usage: " << prog << " mapfile [options]\n"
+         << "  --deliveries N   number of deliveries to generate (default 10)\n"
+         << "  --seed S         random seed (default 1)\n"
+         << "  --out FILE       write to FILE instead of stdout\n";
+}
+
+bool parseArgs(int argc, char* argv[], Options& opts)
+{
+    if (argc < 2)
+        return false;
+    opts.mapFile = argv[1];
+    for (int i = 2; i < argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = i+1 < argc;
+        if (arg == "--deliveries" && hasValue)
+            opts.deliveries = atoll(argv[++i]);
+        else if (arg == "--seed" && hasValue)
+            opts.seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--out" && hasValue)
+            opts.output = argv[++i];
+        else
+            return false;
+    }
+    return opts.deliveries >= 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    Options opts;
+    if (!parseArgs(argc, argv, opts))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    ifstream inf(opts.mapFile);
+    if (!inf)
+    {
+        cerr << "Unable to open map file " << opts.mapFile << endl;
+        return 1;
+    }
+
+    //slot 0 is the depot, the rest are deliveries
+    size_t wanted = (size_t)opts.deliveries + 1;
+    vector<string> reservoir;
+    reservoir.reserve(wanted);
+    mt19937_64 rng(opts.seed);
+    unsigned long long seen = 0;
+
+    auto offer = [&](const string& lat, const string& lon)
+    {
+        seen++;
+        if (reservoir.size() < wanted)
+            reservoir.push_back(lat + " " + lon);
+        else
+        {
+            unsigned long long slot = uniform_int_distribution<unsigned long long>(0, seen-1)(rng);
+            if (slot < wanted)
+                reservoir[slot] = lat + " " + lon;
+        }
+    };
+
+    string line;
+    while (getline(inf, line))                                  //street name
+    {
+        if (!getline(inf, line))                                //segment count
+            break;
+        int count = atoi(line.c_str());
+        for (int i = 0; i < count && getline(inf, line); i++)
+        {
+            istringstream iss(line);
+            string c1, c2, c3, c4;
+            if (!(iss >> c1 >> c2 >> c3 >> c4))
+                continue;
+            offer(c1, c2);
+            offer(c3, c4);
+        }
+    }
+
+    if (reservoir.size() < wanted)
+    {
+        cerr << "Map has too few intersections for " << opts.deliveries << " deliveries" << endl;
+        return 1;
+    }
+
+    ofstream outFile;
+    if (!opts.output.empty())
+    {
+        outFile.open(opts.output);
+        if (!outFile)
+        {
+            cerr << "Unable to open " << opts.output << " for writing" << endl;
+            return 1;
+        }
+    }
+    ostream& out = opts.output.empty() ? cout : outFile;
+
+    out << reservoir[0] << '\n';
+    for (size_t i = 1; i < reservoir.size(); i++)
+        out << reservoir[i] << ':' << ITEMS[(i-1) % NUM_ITEMS] << " #" << i << '\n';
+    return 0;
+}
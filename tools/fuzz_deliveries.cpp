@@ -0,0 +1,100 @@
+// libFuzzer target for the delivery file parser in main.cpp.
+//
+//     ./fuzz_deliveries -close_fd_mask=1 -max_len=1024 corpus/
+//
+// main.cpp is compiled in with its main renamed, so this runs the parser the
+// program itself uses. Each input is written to a file and loaded with
+// loadDeliveryRequests; whatever is in it, loading must not crash or throw,
+// and every delivery it accepts must have an item and coordinates that read
+// back as the numbers they were parsed into. The parser reports bad lines on
+// standard output, which -close_fd_mask=1 silences. Building with
+// -DGOOBEREATS_FUZZ_REPLAY instead of -fsanitize=fuzzer gives a main that runs
+// the files named on the command line through the target, for replaying
+// crashes without libFuzzer.
+
+#define main goobereatsMain
+#include "main.cpp"
+#undef main
+
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <unistd.h>
+
+namespace
+{
+
+  // The input in a temporary file, for as long as this is alive
+class TempFile
+{
+public:
+    TempFile(const uint8_t* data, size_t size)
+    {
+        char path[] = "/tmp/fuzz_deliveries_XXXXXX";
+        int fd = mkstemp(path);
+        if (fd == -1)
+            abort();
+        for (size_t done = 0; done < size; )
+        {
+            ssize_t wrote = write(fd, data + done, size - done);
+            if (wrote <= 0)
+                abort();
+            done += wrote;
+        }
+        close(fd);
+        m_path = path;
+    }
+    ~TempFile() { unlink(m_path.c_str()); }
+    const string& path() const { return m_path; }
+private:
+    string m_path;
+};
+
+void check(bool ok, const char* what)
+{
+    if (!ok)
+    {
+        cerr << "fuzz_deliveries: " << what << endl;
+        abort();
+    }
+}
+
+void checkCoord(const GeoCoord& gc)
+{
+    check(!gc.latitudeText.empty() && !gc.longitudeText.empty(), "a coordinate has no text");
+    check(stod(gc.latitudeText) == gc.latitude || gc.latitude != gc.latitude, "a latitude doesn't read back");
+    check(stod(gc.longitudeText) == gc.longitude || gc.longitude != gc.longitude, "a longitude doesn't read back");
+}
+
+}  // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    TempFile file(data, size);
+    GeoCoord depot;
+    vector<DeliveryRequest> deliveries;
+    if (!loadDeliveryRequests(file.path(), depot, deliveries))
+        return 0;
+    checkCoord(depot);
+    for (int i = 0; i < (int)deliveries.size(); i++)
+    {
+        check(!deliveries[i].item.empty(), "a delivery has no item");
+        check(deliveries[i].item.find('\n') == string::npos, "an item runs over more than one line");
+        checkCoord(deliveries[i].location);
+    }
+    return 0;
+}
+
+#ifdef GOOBEREATS_FUZZ_REPLAY
+int main(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        ifstream inf(argv[i], ios::binary);
+        string input((istreambuf_iterator<char>(inf)), istreambuf_iterator<char>());
+        LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t*>(input.data()), input.size());
+        cerr << argv[i] << ": ok" << endl;
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,112 @@
+// libFuzzer target for StreetMap::load, on text maps and on saved ones.
+//
+//     ./fuzz_mapload -max_len=65536 corpus/
+//
+// Each input is written to a file and loaded on one thread and on three, and
+// the two maps have to agree: the same intersections in the same order, and
+// the same segments leaving each of them, each starting where it is listed.
+// Every intersection's coordinates have to look up that intersection. A file
+// that starts like a saved map goes through the checks its sections have to
+// pass before it is mapped rather than through the text parser, so the corpus
+// should hold a few small maps written by StreetMap::save; with every section
+// on its own page they need a larger -max_len than text does. Building with
+// -DGOOBEREATS_FUZZ_REPLAY instead of -fsanitize=fuzzer gives a main that runs
+// the files named on the command line through the target, for replaying
+// crashes without libFuzzer.
+
+#include "provided.h"
+#include "StreetGraph.h"
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <unistd.h>
+using namespace std;
+
+namespace
+{
+
+  // The input in a temporary file, for as long as this is alive
+class TempFile
+{
+public:
+    TempFile(const uint8_t* data, size_t size)
+    {
+        char path[] = "/tmp/fuzz_mapload_XXXXXX";
+        int fd = mkstemp(path);
+        if (fd == -1)
+            abort();
+        for (size_t done = 0; done < size; )
+        {
+            ssize_t wrote = write(fd, data + done, size - done);
+            if (wrote <= 0)
+                abort();
+            done += wrote;
+        }
+        close(fd);
+        m_path = path;
+    }
+    ~TempFile() { unlink(m_path.c_str()); }
+    const string& path() const { return m_path; }
+private:
+    string m_path;
+};
+
+void check(bool ok, const char* what)
+{
+    if (!ok)
+    {
+        cerr << "fuzz_mapload: " << what << endl;
+        abort();
+    }
+}
+
+}  // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    TempFile file(data, size);
+    StreetMap serial, parallel;
+    bool loaded = serial.load(file.path(), 1);
+    check(parallel.load(file.path(), 3) == loaded, "loading on one thread and on three disagree");
+    if (!loaded)
+        return 0;
+
+    MapSnapshot one = serial.snapshot(), three = parallel.snapshot();
+    check(one->nodeCount() == three->nodeCount(), "different numbers of intersections");
+    check(one->edgeCount() == three->edgeCount(), "different numbers of segments");
+    for (int n = 0; n < one->nodeCount(); n++)
+    {
+        GeoCoord gc = one->coord(n);
+        check(gc == three->coord(n), "intersections numbered differently");
+        check(one->nodeId(gc) == n, "an intersection's coordinates look up another one");
+        vector<StreetSegment> fromOne, fromThree;
+        check(serial.getSegmentsThatStartWith(gc, fromOne), "an intersection can't be looked up");
+        check(parallel.getSegmentsThatStartWith(gc, fromThree), "an intersection can't be looked up");
+        check(fromOne.size() == fromThree.size(), "different segments leave an intersection");
+        for (int k = 0; k < (int)fromOne.size(); k++)
+        {
+            check(fromOne[k].start == gc, "a segment doesn't start where it is listed");
+            check(fromOne[k] == fromThree[k] && fromOne[k].name == fromThree[k].name,
+                  "different segments leave an intersection");
+        }
+    }
+    return 0;
+}
+
+#ifdef GOOBEREATS_FUZZ_REPLAY
+int main(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        ifstream inf(argv[i], ios::binary);
+        string input((istreambuf_iterator<char>(inf)), istreambuf_iterator<char>());
+        LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t*>(input.data()), input.size());
+        cout << argv[i] << ": ok" << endl;
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,36 @@
+// Converts a map in the mapdata.txt format to the binary layout that
+// StreetMap::load maps into memory instead of parsing:
+//
+//     mapconvert mapdata.txt mapdata.map
+//
+// The binary file stores records exactly as they are laid out in memory, so
+// it should be written by a build for the same kind of machine that reads it.
+
+#include "provided.h"
+#include <chrono>
+#include <iostream>
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+    if (argc != 3)
+    {
+        cerr << "Usage: " << argv[0] << " mapdata.txt output.map" << endl;
+        return 1;
+    }
+
+    auto start = chrono::steady_clock::now();
+    StreetMap sm;
+    if (!sm.load(argv[1]))
+    {
+        cerr << "Unable to load map data file " << argv[1] << endl;
+        return 1;
+    }
+    if (!sm.save(argv[2]))
+    {
+        cerr << "Unable to write " << argv[2] << endl;
+        return 1;
+    }
+    cerr << "Converted in " << chrono::duration<double>(chrono::steady_clock::now() - start).count() << " s" << endl;
+    return 0;
+}
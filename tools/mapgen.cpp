@@ -0,0 +1,406 @@
+// Synthetic map generator for scale testing.
+//
+// Writes a map in the same text format that StreetMap::load reads:
+//
+//     <street name>
+//     <number of segments>
+//     <startLat> <startLon> <endLat> <endLon>     (one line per segment)
+//
+// Three topologies are supported:
+//   grid     a rectangular street grid of "N Street"s and "N Avenue"s
+//   radial   concentric ring roads joined by spoke boulevards
+//   perturb  copies of an existing map tiled side by side, with every node
+//            jittered and neighbouring tiles joined by connector streets
+//
+// The output is streamed, so maps with tens of millions of segments can be
+// produced without holding them in memory. The same seed always produces the
+// same file.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+namespace
+{
+
+const double DEFAULT_LAT = 34.0625329;                          //Westwood, so generated maps sit near the sample data
+const double DEFAULT_LON = -118.4470263;
+const double BLOCK_DEG = 0.0008;                                //roughly one city block
+
+struct Options
+{
+    string topology;
+    long long segments = 100000;
+    unsigned long long seed = 1;
+    double centerLat = DEFAULT_LAT;
+    double centerLon = DEFAULT_LON;
+    double jitter = 0.15;                                       //fraction of a block each node may move
+    double drop = 0;                                            //fraction of grid segments to leave out
+    string source;                                              //map to tile in perturb mode
+    string output;                                              //stdout when empty
+};
+
+struct Point
+{
+    double lat;
+    double lon;
+};
+
+void usage(const char* prog)
+{
+    cerr << "Usage: " << prog << " grid|radial|perturb [options]\n"
+         << "  --segments N     approximate number of segments to emit (default 100000)\n"
+         << "  --seed S         random seed (default 1)\n"
+         << "  --center LAT LON centre of the generated map (default Westwood)\n"
+         << "  --jitter F       node jitter as a fraction of a block (default 0.15)\n"
+         << "  --drop F         fraction of grid segments to omit (default 0)\n"
+         << "  --source FILE    map to tile (perturb only)\n"
+         << "  --out FILE       write to FILE instead of stdout\n";
+}
+
+bool parseArgs(int argc, char* argv[], Options& opts)
+{
+    if (argc < 2)
+        return false;
+    opts.topology = argv[1];
+    if (opts.topology != "grid" && opts.topology != "radial" && opts.topology != "perturb")
+        return false;
+    for (int i = 2; i < argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = i+1 < argc;
+        if (arg == "--segments" && hasValue)
+            opts.segments = atoll(argv[++i]);
+        else if (arg == "--seed" && hasValue)
+            opts.seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--center" && i+2 < argc)
+        {
+            opts.centerLat = atof(argv[++i]);
+            opts.centerLon = atof(argv[++i]);
+        }
+        else if (arg == "--jitter" && hasValue)
+            opts.jitter = atof(argv[++i]);
+        else if (arg == "--drop" && hasValue)
+            opts.drop = atof(argv[++i]);
+        else if (arg == "--source" && hasValue)
+            opts.source = argv[++i];
+        else if (arg == "--out" && hasValue)
+            opts.output = argv[++i];
+        else
+            return false;
+    }
+    if (opts.segments <= 0)
+        return false;
+    if (opts.topology == "perturb" && opts.source.empty())
+        return false;
+    return true;
+}
+
+//a stateless 64 bit mix, so that a node's jitter depends only on the seed and the node itself
+unsigned long long mix(unsigned long long x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+double unitFromHash(unsigned long long h)                       //maps a hash onto [-1, 1)
+{
+    return (double)(h >> 11) / (double)(1ULL << 52) - 1.0;
+}
+
+class MapWriter
+{
+public:
+    MapWriter(FILE* out) : m_out(out), m_written(0) {}
+
+    //streets are buffered one at a time since the segment count precedes the segments
+    void beginStreet(const string& name)
+    {
+        m_name = name;
+        m_lines.clear();
+        m_count = 0;
+    }
+    void addSegment(const Point& s, const Point& e)
+    {
+        char buf[96];
+        int n = snprintf(buf, sizeof(buf), "%.7f %.7f %.7f %.7f\n", s.lat, s.lon, e.lat, e.lon);
+        m_lines.append(buf, n);
+        m_count++;
+    }
+    void endStreet()
+    {
+        if (m_count == 0)                                       //a street without segments would not load
+            return;
+        fprintf(m_out, "%s\n%lld\n", m_name.c_str(), m_count);
+        fwrite(m_lines.data(), 1, m_lines.size(), m_out);
+        m_written += m_count;
+    }
+    long long written() const { return m_written; }
+
+private:
+    FILE* m_out;
+    string m_name;
+    string m_lines;
+    long long m_count;
+    long long m_written;
+};
+
+string ordinal(long long n)
+{
+    const char* suffix = "th";
+    if (n % 100 < 11 || n % 100 > 13)
+    {
+        if (n % 10 == 1) suffix = "st";
+        else if (n % 10 == 2) suffix = "nd";
+        else if (n % 10 == 3) suffix = "rd";
+    }
+    return to_string(n) + suffix;
+}
+
+//a grid of R rows and C columns has R*(C-1) + C*(R-1) segments
+void generateGrid(const Options& opts, MapWriter& writer)
+{
+    long long side = (long long)ceil(sqrt(opts.segments / 2.0)) + 1;
+    long long rows = side, cols = side;
+    double jitter = opts.jitter * BLOCK_DEG;
+    double lat0 = opts.centerLat - rows * BLOCK_DEG / 2;
+    double lon0 = opts.centerLon - cols * BLOCK_DEG / 2;
+
+    auto node = [&](long long r, long long c)
+    {
+        unsigned long long h = mix(opts.seed ^ mix(r * 0x100000001ULL + c));
+        Point p;
+        p.lat = lat0 + r * BLOCK_DEG + unitFromHash(h) * jitter;
+        p.lon = lon0 + c * BLOCK_DEG + unitFromHash(mix(h)) * jitter;
+        return p;
+    };
+    mt19937_64 rng(opts.seed);
+    uniform_real_distribution<double> coin(0, 1);
+
+    for (long long r = 0; r < rows; r++)                        //east-west streets
+    {
+        writer.beginStreet(ordinal(r+1) + " Street");
+        for (long long c = 0; c+1 < cols; c++)
+            if (coin(rng) >= opts.drop)
+                writer.addSegment(node(r, c), node(r, c+1));
+        writer.endStreet();
+    }
+    for (long long c = 0; c < cols; c++)                        //north-south avenues
+    {
+        writer.beginStreet(ordinal(c+1) + " Avenue");
+        for (long long r = 0; r+1 < rows; r++)
+            if (coin(rng) >= opts.drop)
+                writer.addSegment(node(r, c), node(r+1, c));
+        writer.endStreet();
+    }
+}
+
+//R rings of S nodes each, joined by S spokes, have about 2*R*S segments
+void generateRadial(const Options& opts, MapWriter& writer)
+{
+    long long rings = (long long)ceil(sqrt(opts.segments / 8.0));
+    long long spokes = max(8LL, 4 * rings);
+    const double PI = 4 * atan(1.0);
+    double lonScale = 1 / cos(opts.centerLat * PI / 180);       //keep rings round on the ground
+
+    Point hub = { opts.centerLat, opts.centerLon };
+    auto node = [&](long long ring, long long spoke)
+    {
+        unsigned long long h = mix(opts.seed ^ mix(ring * 0x100000001ULL + spoke));
+        double radius = (ring+1) * BLOCK_DEG;
+        double theta = 2 * PI * spoke / spokes;
+        double jitter = opts.jitter * min(BLOCK_DEG, 2 * PI * radius / spokes);   //inner rings are crowded
+        Point p;
+        p.lat = hub.lat + radius * sin(theta) + unitFromHash(h) * jitter;
+        p.lon = hub.lon + radius * cos(theta) * lonScale + unitFromHash(mix(h)) * jitter;
+        return p;
+    };
+
+    for (long long ring = 0; ring < rings; ring++)
+    {
+        writer.beginStreet("Ring Road " + to_string(ring+1));
+        for (long long s = 0; s < spokes; s++)
+            writer.addSegment(node(ring, s), node(ring, (s+1) % spokes));
+        writer.endStreet();
+    }
+    for (long long s = 0; s < spokes; s++)
+    {
+        writer.beginStreet("Spoke Boulevard " + to_string(s+1));
+        if (s % 4 == 0)                                         //every fourth spoke reaches the hub
+            writer.addSegment(hub, node(0, s));
+        for (long long ring = 0; ring+1 < rings; ring++)
+            writer.addSegment(node(ring, s), node(ring+1, s));
+        writer.endStreet();
+    }
+}
+
+struct SourceStreet
+{
+    string name;
+    vector<string> coords;                                      //four coordinate strings per segment
+};
+
+bool readSource(const string& file, vector<SourceStreet>& streets, long long& segmentCount)
+{
+    ifstream inf(file);
+    if (!inf)
+        return false;
+    string line;
+    segmentCount = 0;
+    while (getline(inf, line))
+    {
+        SourceStreet st;
+        st.name = line;
+        if (!getline(inf, line))
+            break;
+        int count = atoi(line.c_str());
+        for (int i = 0; i < count && getline(inf, line); i++)
+        {
+            istringstream iss(line);
+            string c[4];
+            if (!(iss >> c[0] >> c[1] >> c[2] >> c[3]))
+                return false;
+            st.coords.insert(st.coords.end(), c, c+4);
+            segmentCount++;
+        }
+        streets.push_back(st);
+    }
+    return segmentCount > 0;
+}
+
+//tiles a real map across a square of copies; every copy jitters each original node the same way
+//within the copy so that intersections stay shared, and connector streets join adjacent copies
+void generatePerturbed(const Options& opts, MapWriter& writer)
+{
+    vector<SourceStreet> streets;
+    long long perTile = 0;
+    if (!readSource(opts.source, streets, perTile))
+    {
+        cerr << "Unable to read source map " << opts.source << endl;
+        exit(1);
+    }
+
+    double minLat = 1e9, maxLat = -1e9, minLon = 1e9, maxLon = -1e9;
+    unordered_map<string, Point> nodes;
+    vector<string> nodeKeys;                                    //insertion order, for reproducible connectors
+    for (const SourceStreet& st : streets)
+        for (size_t i = 0; i < st.coords.size(); i += 2)
+        {
+            string key = st.coords[i] + " " + st.coords[i+1];
+            if (nodes.count(key))
+                continue;
+            Point p = { atof(st.coords[i].c_str()), atof(st.coords[i+1].c_str()) };
+            nodes[key] = p;
+            nodeKeys.push_back(key);
+            minLat = min(minLat, p.lat); maxLat = max(maxLat, p.lat);
+            minLon = min(minLon, p.lon); maxLon = max(maxLon, p.lon);
+        }
+
+    long long tiles = max(1LL, (opts.segments + perTile - 1) / perTile);
+    long long side = (long long)ceil(sqrt((double)tiles));
+    double tileLat = (maxLat - minLat) + 4 * BLOCK_DEG;
+    double tileLon = (maxLon - minLon) + 4 * BLOCK_DEG;
+    double jitter = opts.jitter * BLOCK_DEG;
+    hash<string> strHash;
+
+    auto place = [&](const string& key, long long tile)
+    {
+        const Point& p = nodes[key];
+        unsigned long long h = mix(opts.seed ^ mix(strHash(key)) ^ mix(tile));
+        Point q;
+        q.lat = p.lat - minLat + opts.centerLat + (tile / side) * tileLat + unitFromHash(h) * jitter;
+        q.lon = p.lon - minLon + opts.centerLon + (tile % side) * tileLon + unitFromHash(mix(h)) * jitter;
+        return q;
+    };
+
+    //the nodes closest to each edge of the source map are where neighbouring copies get joined
+    const size_t connectors = 8;
+    auto extremes = [&](auto better)
+    {
+        vector<string> keys = nodeKeys;
+        size_t n = min(connectors, keys.size());
+        partial_sort(keys.begin(), keys.begin() + n, keys.end(),
+                     [&](const string& a, const string& b) { return better(nodes[a], nodes[b]); });
+        keys.resize(n);
+        return keys;
+    };
+    vector<string> east = extremes([](const Point& a, const Point& b) { return a.lon > b.lon; });
+    vector<string> west = extremes([](const Point& a, const Point& b) { return a.lon < b.lon; });
+    vector<string> north = extremes([](const Point& a, const Point& b) { return a.lat > b.lat; });
+    vector<string> south = extremes([](const Point& a, const Point& b) { return a.lat < b.lat; });
+
+    for (long long t = 0; t < tiles; t++)
+    {
+        string suffix = tiles > 1 ? " " + to_string(t+1) : "";
+        for (const SourceStreet& st : streets)
+        {
+            writer.beginStreet(st.name + suffix);
+            for (size_t i = 0; i < st.coords.size(); i += 4)
+                writer.addSegment(place(st.coords[i] + " " + st.coords[i+1], t),
+                                  place(st.coords[i+2] + " " + st.coords[i+3], t));
+            writer.endStreet();
+        }
+        if (t % side + 1 < side && t+1 < tiles)                 //join to the copy on the east
+        {
+            writer.beginStreet("East Connector " + to_string(t+1));
+            for (size_t i = 0; i < east.size(); i++)
+                writer.addSegment(place(east[i], t), place(west[i], t+1));
+            writer.endStreet();
+        }
+        if (t + side < tiles)                                   //and to the copy on the north
+        {
+            writer.beginStreet("North Connector " + to_string(t+1));
+            for (size_t i = 0; i < north.size(); i++)
+                writer.addSegment(place(north[i], t), place(south[i], t+side));
+            writer.endStreet();
+        }
+    }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    Options opts;
+    if (!parseArgs(argc, argv, opts))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    FILE* out = stdout;
+    if (!opts.output.empty() && (out = fopen(opts.output.c_str(), "w")) == nullptr)
+    {
+        cerr << "Unable to open " << opts.output << " for writing" << endl;
+        return 1;
+    }
+    static char buffer[1 << 20];
+    setvbuf(out, buffer, _IOFBF, sizeof(buffer));
+
+    MapWriter writer(out);
+    if (opts.topology == "grid")
+        generateGrid(opts, writer);
+    else if (opts.topology == "radial")
+        generateRadial(opts, writer);
+    else
+        generatePerturbed(opts, writer);
+
+    if (out != stdout)
+        fclose(out);
+    else
+        fflush(out);
+    cerr << writer.written() << " segments written" << endl;
+    return 0;
+}
@@ -0,0 +1,201 @@
+// Compares route query speed on the same map loaded with each NodeOrder.
+//
+//     orderbench mapdata.txt --queries 2000 --cost distance
+//
+// The same random pairs of intersections are routed on every numbering. For
+// each one it prints the load time, the mean query time, the mean gap between
+// the numbers of the two ends of an edge (how far apart in memory a search
+// step jumps) and, where the kernel allows perf counters, the cache misses
+// per query.
+
+#include "provided.h"
+#include "StreetGraph.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+namespace
+{
+
+struct Options
+{
+    string mapFile;
+    int queries = 1000;
+    unsigned long long seed = 1;
+    RouteCost cost = COST_HOPS;
+};
+
+void usage(const char* prog)
+{
+    cerr << "Usage: " << prog << " mapfile [options]\n"
+         << "  --queries N      routes to time on each numbering (default 1000)\n"
+         << "  --seed S         random seed for picking their ends (default 1)\n"
+         << "  --cost C         hops, distance, time or turns (default hops)\n";
+}
+
+bool parseArgs(int argc, char* argv[], Options& opts)
+{
+    if (argc < 2)
+        return false;
+    opts.mapFile = argv[1];
+    for (int i = 2; i < argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = i+1 < argc;
+        if (arg == "--queries" && hasValue)
+            opts.queries = atoi(argv[++i]);
+        else if (arg == "--seed" && hasValue)
+            opts.seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--cost" && hasValue)
+        {
+            string cost = argv[++i];
+            if (cost == "hops")
+                opts.cost = COST_HOPS;
+            else if (cost == "distance")
+                opts.cost = COST_DISTANCE;
+            else if (cost == "time")
+                opts.cost = COST_TRAVEL_TIME;
+            else if (cost == "turns")
+                opts.cost = COST_TRAVEL_TIME_WITH_TURNS;
+            else
+                return false;
+        }
+        else
+            return false;
+    }
+    return opts.queries > 0;
+}
+
+  // Hardware cache misses on this thread, or nothing where perf counters
+  // aren't available
+class CacheMissCounter
+{
+public:
+    CacheMissCounter()
+     : m_fd(-1)
+    {
+#ifdef __linux__
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        m_fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+    ~CacheMissCounter()
+    {
+#ifdef __linux__
+        if (m_fd >= 0)
+            close(m_fd);
+#endif
+    }
+    bool available() const { return m_fd >= 0; }
+    void start()
+    {
+#ifdef __linux__
+        if (m_fd >= 0)
+        {
+            ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+    long long stop()
+    {
+        long long count = 0;
+#ifdef __linux__
+        if (m_fd >= 0)
+        {
+            ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(m_fd, &count, sizeof(count)) != sizeof(count))
+                count = 0;
+        }
+#endif
+        return count;
+    }
+private:
+    int m_fd;
+};
+
+double meanEdgeGap(const StreetGraph& graph)
+{
+    double total = 0;
+    for (int e = 0; e < graph.edgeCount(); e++)
+        total += abs(graph.edgeTo(e) - graph.edgeFrom(e));
+    return graph.edgeCount() > 0 ? total / graph.edgeCount() : 0;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    Options opts;
+    if (!parseArgs(argc, argv, opts))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const NodeOrder ORDERS[] = { ORDER_FILE, ORDER_HILBERT, ORDER_BFS };
+    const char* const NAMES[] = { "file", "hilbert", "bfs" };
+    vector<pair<GeoCoord, GeoCoord> > pairs;
+    CacheMissCounter misses;
+    if (!misses.available())
+        cerr << "Hardware cache miss counter unavailable; only times are reported" << endl;
+
+    for (int o = 0; o < 3; o++)
+    {
+        StreetMap sm;
+        sm.setNodeOrder(ORDERS[o]);
+        auto loadStart = chrono::steady_clock::now();
+        if (!sm.load(opts.mapFile))
+        {
+            cerr << "Unable to load map data file " << opts.mapFile << endl;
+            return 1;
+        }
+        double loadSeconds = chrono::duration<double>(chrono::steady_clock::now() - loadStart).count();
+        MapSnapshot map = sm.snapshot();
+
+        if (pairs.empty())                  // picked once, so every numbering routes the same pairs
+        {
+            mt19937_64 rng(opts.seed);
+            for (int i = 0; i < opts.queries; i++)
+                pairs.push_back(make_pair(map->coord((int)(rng() % map->nodeCount())),
+                                          map->coord((int)(rng() % map->nodeCount()))));
+        }
+
+        PointToPointRouter router(&sm, opts.cost);
+        Route route;
+        router.generatePointToPointRoute(map, pairs[0].first, pairs[0].second, route);   // grows the search arena
+        int found = 0;
+        misses.start();
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < (int)pairs.size(); i++)
+            found += router.generatePointToPointRoute(map, pairs[i].first, pairs[i].second, route) == DELIVERY_SUCCESS;
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        long long missCount = misses.stop();
+
+        cout << NAMES[o] << ": load " << loadSeconds << " s, "
+             << seconds / pairs.size() * 1e6 << " us/query (" << found << " routed), "
+             << "mean edge gap " << meanEdgeGap(*map);
+        if (misses.available())
+            cout << ", " << (double)missCount / pairs.size() << " cache misses/query";
+        cout << endl;
+    }
+    return 0;
+}
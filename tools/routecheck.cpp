@@ -0,0 +1,388 @@
+// Checks PointToPointRouter against a plain Dijkstra's algorithm written from
+// nothing but StreetMap::getSegmentsThatStartWith, on random pairs of
+// intersections.
+//
+//     routecheck mapdata.txt --queries 500 --seed 1 --close 20
+//
+// Every RouteCost is checked. A route has to be a chain of open segments from
+// the start to the end, with distances that add up, and has to cost the same
+// as the reference's cheapest (routes tied on cost may differ). The first of
+// generateAlternativeRoutes has to be as cheap and the rest valid and within
+// the stretch allowed, and findReachable has to list every intersection the
+// reference reaches within the limit at the same distance. --close closes
+// that many random segments first, so routes have to go around them. Each
+// mismatch is printed, and the exit status is 1 if there were any.
+
+#include "provided.h"
+#include "StreetGraph.h"
+#include "CostProfiles.h"
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+namespace
+{
+
+struct Options
+{
+    string mapFile;
+    int queries = 200;
+    unsigned long long seed = 1;
+    int closures = 0;
+    int alternatives = 3;
+};
+
+void usage(const char* prog)
+{
+    cerr << "Usage: " << prog << " mapfile [options]\n"
+         << "  --queries N       random pairs of intersections to route (default 200)\n"
+         << "  --seed S          random seed for the pairs and closures (default 1)\n"
+         << "  --close N         segments to close before routing (default 0)\n"
+         << "  --alternatives K  routes to ask generateAlternativeRoutes for, 0 to skip (default 3)\n";
+}
+
+bool parseArgs(int argc, char* argv[], Options& opts)
+{
+    if (argc < 2)
+        return false;
+    opts.mapFile = argv[1];
+    for (int i = 2; i < argc; i++)
+    {
+        string arg = argv[i];
+        bool hasValue = i+1 < argc;
+        if (arg == "--queries" && hasValue)
+            opts.queries = atoi(argv[++i]);
+        else if (arg == "--seed" && hasValue)
+            opts.seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--close" && hasValue)
+            opts.closures = atoi(argv[++i]);
+        else if (arg == "--alternatives" && hasValue)
+            opts.alternatives = atoi(argv[++i]);
+        else
+            return false;
+    }
+    return opts.queries > 0 && opts.closures >= 0 && opts.alternatives >= 0;
+}
+
+const RouteCost COSTS[] = { COST_HOPS, COST_DISTANCE, COST_TRAVEL_TIME, COST_TRAVEL_TIME_WITH_TURNS };
+const char* const COST_NAMES[] = { "hops", "distance", "time", "turns" };
+const double LEFT_TURN_HOURS = 20 / 3600.0;         // as in PointToPointRouter.cpp
+const double U_TURN_HOURS = 60 / 3600.0;
+const double INFINITE = numeric_limits<double>::infinity();
+
+bool sameCost(double a, double b)
+{
+    return fabs(a - b) <= 1e-9 * max(1.0, max(fabs(a), fabs(b)));
+}
+
+  // The open segments of a map as getSegmentsThatStartWith gives them, with
+  // the intersections numbered by the reference itself
+class ReferenceMap
+{
+public:
+    explicit ReferenceMap(const StreetMap& sm)
+    {
+        MapSnapshot map = sm.snapshot();
+        for (int i = 0; i < map->nodeCount(); i++)
+            nodeOf(map->coord(i));
+        for (int n = 0; n < (int)m_coords.size(); n++)
+        {
+            vector<StreetSegment> segs;
+            sm.getSegmentsThatStartWith(m_coords[n], segs);
+            for (int k = 0; k < (int)segs.size(); k++)
+            {
+                m_out[n].push_back((int)m_segments.size());
+                m_segments.push_back(segs[k]);
+                m_from.push_back(n);
+                m_to.push_back(nodeOf(segs[k].end));
+                m_miles.push_back(distanceEarthMiles(segs[k].start, segs[k].end));
+                m_hours.push_back(m_miles.back() / streetSpeed(segs[k].name.c_str()));
+                m_angle.push_back((float)angleOfLine(segs[k]));     // the router keeps angles as floats
+            }
+        }
+    }
+
+    int nodeCount() const { return (int)m_coords.size(); }
+    const GeoCoord& coord(int node) const { return m_coords[node]; }
+    int find(const GeoCoord& gc) const
+    {
+        map<GeoCoord, int>::const_iterator it = m_ids.find(gc);
+        return it == m_ids.end() ? -1 : it->second;
+    }
+    // the open segment from start to end, or -1
+    int segment(const StreetSegment& seg) const
+    {
+        int from = find(seg.start);
+        if (from == -1)
+            return -1;
+        for (int k = 0; k < (int)m_out[from].size(); k++)
+            if (m_segments[m_out[from][k]].end == seg.end)
+                return m_out[from][k];
+        return -1;
+    }
+    double segmentMiles(int s) const { return m_miles[s]; }
+
+    // the cost of taking segment s straight after segment before (-1 at the start)
+    double segmentCost(RouteCost kind, int before, int s) const
+    {
+        switch (kind)
+        {
+            case COST_HOPS:
+                return 1;
+            case COST_DISTANCE:
+                return m_miles[s];
+            case COST_TRAVEL_TIME:
+                return m_hours[s];
+            default:
+                break;
+        }
+        double turn = 0;
+        if (before != -1)
+        {
+            double angle = (double)m_angle[s] - m_angle[before];
+            if (angle < 0)
+                angle += 360;
+            if (m_to[s] == m_from[before])
+                turn = U_TURN_HOURS;
+            else if (angle >= 30 && angle < 180)
+                turn = LEFT_TURN_HOURS;
+        }
+        return m_hours[s] + turn;
+    }
+
+    // Dijkstra's algorithm from start, settling states up to limit or until end
+    // is settled; returns the cost to end (infinity if it wasn't reached) and
+    // fills in the cost to every node settled. Costs that depend on turns are
+    // searched over segments, the others over intersections.
+    double cheapest(RouteCost kind, int start, int end, double limit, vector<double>& reached) const
+    {
+        reached.assign(m_coords.size(), INFINITE);
+        bool turnAware = kind == COST_TRAVEL_TIME_WITH_TURNS;
+        vector<double> best(turnAware ? m_segments.size() : m_coords.size(), INFINITE);
+        vector<bool> done(best.size(), false);
+        priority_queue<pair<double, int>, vector<pair<double, int> >, greater<pair<double, int> > > queue;
+        reached[start] = 0;
+        if (start == end)
+            return 0;
+        auto push = [&](int state, double c) {
+            if (c < best[state])
+            {
+                best[state] = c;
+                queue.push(make_pair(c, state));
+            }
+        };
+        if (turnAware)
+            for (int k = 0; k < (int)m_out[start].size(); k++)
+                push(m_out[start][k], segmentCost(kind, -1, m_out[start][k]));
+        else
+            push(start, 0);
+        while (!queue.empty())
+        {
+            pair<double, int> top = queue.top();
+            queue.pop();
+            if (top.first > limit)
+                break;
+            if (done[top.second])
+                continue;
+            done[top.second] = true;
+            int node = turnAware ? m_to[top.second] : top.second;
+            reached[node] = min(reached[node], top.first);
+            if (node == end)
+                return top.first;
+            for (int k = 0; k < (int)m_out[node].size(); k++)
+            {
+                int s = m_out[node][k];
+                push(turnAware ? s : m_to[s], top.first + segmentCost(kind, turnAware ? top.second : -1, s));
+            }
+        }
+        return INFINITE;
+    }
+
+private:
+    map<GeoCoord, int> m_ids;
+    vector<GeoCoord> m_coords;
+    vector<vector<int> > m_out;
+    vector<StreetSegment> m_segments;
+    vector<int> m_from, m_to;
+    vector<double> m_miles, m_hours;
+    vector<float> m_angle;
+
+    int nodeOf(const GeoCoord& gc)
+    {
+        map<GeoCoord, int>::iterator it = m_ids.find(gc);
+        if (it != m_ids.end())
+            return it->second;
+        m_ids[gc] = (int)m_coords.size();
+        m_coords.push_back(gc);
+        m_out.push_back(vector<int>());
+        return (int)m_coords.size() - 1;
+    }
+};
+
+  // What is wrong with route as a way from start to end, or "" if nothing is;
+  // its cost by the reference goes in cost
+string checkRoute(const ReferenceMap& ref, RouteCost costKind, const Route& route,
+                  const GeoCoord& start, const GeoCoord& end, double& cost)
+{
+    cost = 0;
+    double miles = 0;
+    int before = -1;
+    GeoCoord at = start;
+    for (int i = 0; i < route.size(); i++)
+    {
+        StreetSegment seg = route.segment(i);
+        if (seg.start != at)
+            return "segment " + to_string(i) + " does not start where the one before ends";
+        int s = ref.segment(seg);
+        if (s == -1)
+            return "segment " + to_string(i) + " is not an open segment of the map";
+        miles += ref.segmentMiles(s);
+        if (!sameCost(route.distanceAfter(i), miles))
+            return "distance after segment " + to_string(i) + " is " + to_string(route.distanceAfter(i)) +
+                   ", segments add up to " + to_string(miles);
+        cost += ref.segmentCost(costKind, before, s);
+        before = s;
+        at = seg.end;
+    }
+    if (at != end)
+        return "route ends at " + at.latitudeText + " " + at.longitudeText;
+    return "";
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    Options opts;
+    if (!parseArgs(argc, argv, opts))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    StreetMap sm;
+    if (!sm.load(opts.mapFile))
+    {
+        cerr << "Unable to load map data file " << opts.mapFile << endl;
+        return 1;
+    }
+    mt19937_64 rng(opts.seed);
+    MapSnapshot map = sm.snapshot();
+    if (map->nodeCount() == 0)
+    {
+        cerr << "Map has no intersections" << endl;
+        return 1;
+    }
+    int closed = 0;
+    for (int i = 0; i < opts.closures * 10 && closed < opts.closures; i++)
+    {
+        vector<StreetSegment> segs;
+        sm.getSegmentsThatStartWith(map->coord((int)(rng() % map->nodeCount())), segs);
+        if (!segs.empty())
+        {
+            const StreetSegment& seg = segs[rng() % segs.size()];
+            closed += sm.closeSegment(seg.start, seg.end);
+        }
+    }
+    ReferenceMap ref(sm);
+
+    int mismatches = 0, routed = 0;
+    auto report = [&](int c, const GeoCoord& start, const GeoCoord& end, const string& what) {
+        cout << COST_NAMES[c] << " " << start.latitudeText << " " << start.longitudeText << " -> "
+             << end.latitudeText << " " << end.longitudeText << ": " << what << endl;
+        mismatches++;
+    };
+    vector<double> reached;
+    for (int c = 0; c < 4; c++)
+    {
+        PointToPointRouter router(&sm, COSTS[c]);
+        Route route;
+        GeoCoord nowhere("0.5", "0.5");
+        if (router.generatePointToPointRoute(nowhere, ref.coord(0), route) != BAD_COORD)
+            report(c, nowhere, ref.coord(0), "a location off the map is not BAD_COORD");
+        mt19937_64 pairs(opts.seed);                    // the same pairs for every cost
+        for (int q = 0; q < opts.queries; q++)
+        {
+            int startNode = (int)(pairs() % ref.nodeCount());
+            int endNode = q % 50 == 0 ? startNode : (int)(pairs() % ref.nodeCount());
+            const GeoCoord& start = ref.coord(startNode);
+            const GeoCoord& end = ref.coord(endNode);
+            double best = ref.cheapest(COSTS[c], startNode, endNode, INFINITE, reached);
+
+            DeliveryResult result = router.generatePointToPointRoute(start, end, route);
+            double cost;
+            string problem;
+            if (result != (best == INFINITE ? NO_ROUTE : DELIVERY_SUCCESS))
+                report(c, start, end, best == INFINITE ? "found a route where there is none" : "found no route");
+            else if (result == DELIVERY_SUCCESS)
+            {
+                routed++;
+                if (!(problem = checkRoute(ref, COSTS[c], route, start, end, cost)).empty())
+                    report(c, start, end, problem);
+                else if (!sameCost(cost, best))
+                    report(c, start, end, "route costs " + to_string(cost) + ", cheapest is " + to_string(best));
+                list<StreetSegment> segments;
+                double total = 0;
+                router.generatePointToPointRoute(start, end, segments, total);
+                if ((int)segments.size() != route.size() || !sameCost(total, route.totalDistance()))
+                    report(c, start, end, "the list of segments differs from the route");
+            }
+
+            if (opts.alternatives > 0 && startNode != endNode)
+            {
+                RouteCost plain = COSTS[c] == COST_TRAVEL_TIME_WITH_TURNS ? COST_TRAVEL_TIME : COSTS[c];
+                double plainBest = plain == COSTS[c] ? best : ref.cheapest(plain, startNode, endNode, INFINITE, reached);
+                vector<Route> routes;
+                result = router.generateAlternativeRoutes(start, end, opts.alternatives, routes);
+                if (result != (plainBest == INFINITE ? NO_ROUTE : DELIVERY_SUCCESS) ||
+                    (result == DELIVERY_SUCCESS && (routes.empty() || (int)routes.size() > opts.alternatives)))
+                    report(c, start, end, "generateAlternativeRoutes gave the wrong result or number of routes");
+                for (int r = 0; r < (int)routes.size(); r++)
+                {
+                    if (!(problem = checkRoute(ref, plain, routes[r], start, end, cost)).empty())
+                        report(c, start, end, "alternative " + to_string(r) + ": " + problem);
+                    else if (r == 0 ? !sameCost(cost, plainBest) : cost > 1.25 * plainBest * (1 + 1e-9))
+                        report(c, start, end, "alternative " + to_string(r) + " costs " + to_string(cost) +
+                                              ", cheapest is " + to_string(plainBest));
+                }
+            }
+
+            if (c == 0)                                 // findReachable is by distance whatever the cost
+            {
+                double miles = ref.cheapest(COST_DISTANCE, startNode, endNode, INFINITE, reached);
+                double limit = miles == INFINITE ? 1 : miles;
+                ref.cheapest(COST_DISTANCE, startNode, -1, limit * (1 + 1e-9), reached);
+                vector<ReachableLocation> reachable;
+                router.findReachable(start, limit, reachable);
+                int within = 0;
+                for (int n = 0; n < ref.nodeCount(); n++)
+                    within += reached[n] <= limit * (1 - 1e-9);
+                int listed = 0;
+                for (int i = 0; i < (int)reachable.size(); i++)
+                {
+                    int n = ref.find(reachable[i].location);
+                    if (n == -1 || !sameCost(reachable[i].distance, reached[n]))
+                    {
+                        report(c, start, end, "findReachable lists " + reachable[i].location.latitudeText + " " +
+                                              reachable[i].location.longitudeText + " at the wrong distance");
+                        break;
+                    }
+                    listed += reached[n] <= limit * (1 - 1e-9);
+                }
+                if (listed != within)
+                    report(c, start, end, "findReachable lists " + to_string(listed) + " of the " + to_string(within) +
+                                          " intersections within " + to_string(limit) + " miles");
+            }
+        }
+    }
+
+    cout << opts.queries << " pairs, " << routed << " routes over 4 costs, " << closed
+         << " segments closed: " << mismatches << " mismatches" << endl;
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+// Checks that StreetMap::load turns down saved maps whose headers lie.
+//
+//     savecheck mapdata.txt
+//
+// The map is loaded and saved to a temporary file, which has to load again.
+// Then copies of it with one header field (and sometimes one record) changed
+// are loaded. Each change either points a section past the end of the file,
+// directly or through a sum that wraps around 64 bits, or describes records
+// the file doesn't hold. Each copy has to be turned down without crashing.
+// The exit status is 1 if the saved map doesn't load or a bad copy does.
+
+#include "provided.h"
+#include "StreetGraph.h"
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <unistd.h>
+using namespace std;
+
+namespace
+{
+
+const unsigned long long WRAP = 0xFFFFFFFFFFFFF000ULL;     //a page aligned offset that wraps anything added to it
+
+struct Change
+{
+    const char* what;
+    size_t field;                                           //offset of the header field to change
+    unsigned long long value;
+    bool wide;                                              //a 64-bit field rather than a 32-bit one
+    bool moveNodeText;                                      //also point node 0's text far past the pool
+};
+
+const Change CHANGES[] = {
+    { "text size that wraps past the end", offsetof(GraphFileHeader, textSize), ~0ULL, true, false },
+    { "text size that wraps, node text out of range", offsetof(GraphFileHeader, textSize), ~0ULL, true, true },
+    { "node section that wraps", offsetof(GraphFileHeader, nodeOffset), WRAP, true, false },
+    { "edge section that wraps", offsetof(GraphFileHeader, edgeOffset), WRAP, true, false },
+    { "street section that wraps", offsetof(GraphFileHeader, streetOffset), WRAP, true, false },
+    { "index section that wraps", offsetof(GraphFileHeader, indexOffset), WRAP, true, false },
+    { "component section that wraps", offsetof(GraphFileHeader, componentOffset), WRAP, true, false },
+    { "text section that wraps", offsetof(GraphFileHeader, textOffset), WRAP, true, false },
+    { "text section past the end", offsetof(GraphFileHeader, textOffset), 1ULL << 40, true, false },
+    { "more edges than the file holds", offsetof(GraphFileHeader, edgeCount), 0xFFFFFFFEULL, false, false },
+    { "more nodes than the file holds", offsetof(GraphFileHeader, nodeCount), 0xFFFFFFFEULL, false, false },
+    { "more index slots than the file holds", offsetof(GraphFileHeader, indexSlots), 0x80000000ULL, false, false },
+};
+
+string tempPath()
+{
+    char path[] = "/tmp/savecheck_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1)
+        abort();
+    close(fd);
+    return path;
+}
+
+bool writeFile(const string& path, const string& contents)
+{
+    ofstream outf(path, ios::binary | ios::trunc);
+    outf.write(contents.data(), (streamsize)contents.size());
+    return (bool)outf.flush();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2)
+    {
+        cerr << "Usage: " << argv[0] << " mapfile" << endl;
+        return 1;
+    }
+    StreetMap sm;
+    if (!sm.load(argv[1]))
+    {
+        cerr << "Unable to load map data file " << argv[1] << endl;
+        return 1;
+    }
+    string saved = tempPath(), changed = tempPath();
+    bool failed = false;
+    StreetMap reloaded;
+    if (!sm.save(saved) || !reloaded.load(saved))
+    {
+        cout << "the saved map doesn't load again" << endl;
+        failed = true;
+    }
+
+    ifstream inf(saved, ios::binary);
+    string original((istreambuf_iterator<char>(inf)), istreambuf_iterator<char>());
+    GraphFileHeader h;
+    if (!failed && original.size() >= sizeof(h))
+    {
+        memcpy(&h, original.data(), sizeof(h));
+        for (const Change& c : CHANGES)
+        {
+            string contents = original;
+            if (c.wide)
+                memcpy(&contents[c.field], &c.value, sizeof(unsigned long long));
+            else
+            {
+                unsigned int narrow = (unsigned int)c.value;
+                memcpy(&contents[c.field], &narrow, sizeof(narrow));
+            }
+            if (c.moveNodeText)
+            {
+                unsigned int text = 0xF0000000;
+                memcpy(&contents[h.nodeOffset + offsetof(GraphNode, text)], &text, sizeof(text));
+            }
+            StreetMap sm2;
+            bool loaded = writeFile(changed, contents) && sm2.load(changed);
+            cout << c.what << ": " << (loaded ? "loaded" : "turned down") << endl;
+            failed |= loaded;
+        }
+    }
+    unlink(saved.c_str());
+    unlink(changed.c_str());
+    return failed ? 1 : 0;
+}